@@ -1,15 +1,182 @@
 #include "analyser.h"
 
+#include <algorithm>
 #include <climits>
+#include <iterator>
+
+#include "stats/timer.h"
 
 namespace miniplc0 {
+namespace {
+// 把 v 的 [first, last) 替换成 r，只移动一次后面的元素
+template <typename Vector>
+void splice(Vector &v, std::size_t first, std::size_t last, Vector &r) {
+  auto common = std::min(last - first, r.size());
+  std::move(r.begin(), r.begin() + common, v.begin() + first);
+  if (common < last - first)
+    v.erase(v.begin() + first + common, v.begin() + last);
+  else
+    v.insert(v.begin() + last, std::make_move_iterator(r.begin() + common),
+             std::make_move_iterator(r.end()));
+}
+}  // namespace
+
 std::pair<std::vector<Instruction>, std::optional<CompilationError>>
 Analyser::Analyse() {
-  auto err = analyseProgram();
-  if (err.has_value())
-    return std::make_pair(std::vector<Instruction>(), err);
+  auto p = AnalyseWithRecovery(1);
+  if (!p.second.empty())
+    return std::make_pair(std::vector<Instruction>(),
+                          std::make_optional(p.second.front()));
   else
-    return std::make_pair(_instructions, std::optional<CompilationError>());
+    return std::make_pair(p.first, std::optional<CompilationError>());
+}
+
+std::pair<std::vector<Instruction>, std::vector<CompilationError>>
+Analyser::AnalyseWithRecovery(std::size_t max_errors) {
+  analyseAll(max_errors);
+  return std::make_pair(_instructions, _errors);
+}
+
+std::pair<Ast, std::vector<CompilationError>> Analyser::AnalyseToAst(
+    std::size_t max_errors) {
+  Ast ast(_vars.get_allocator().resource());
+  _ast = &ast;
+  analyseAll(max_errors);
+  _ast = nullptr;
+  if (!_errors.empty()) ast.Clear();
+  return std::make_pair(std::move(ast), _errors);
+}
+
+std::vector<CompilationError> Analyser::Reanalyse(std::vector<Token> tokens,
+                                                  std::size_t first,
+                                                  std::size_t last,
+                                                  std::size_t max_errors) {
+  if (first > last || last > tokens.size() ||
+      last + _token_count < first + tokens.size())
+    DieAndPrint("invalid token range for reanalysis.");
+  _incremental = true;
+  // 声明没有变化：第一个新 token 在 <语句序列> 之后
+  // 或者 <语句序列> 的第一个 token 变了，但它仍然不能开始一个声明
+  bool same_declarations =
+      first > _declaration_end ||
+      (first == _declaration_end && first < tokens.size() &&
+       tokens[first].GetType() != TokenType::CONST &&
+       tokens[first].GetType() != TokenType::VAR);
+  if (!_cached || !same_declarations) {
+    _tokens = std::move(tokens);
+    analyseAll(max_errors);
+    return _errors;
+  }
+
+  // 新的 token 下标 = 旧的 token 下标 + shift，[first, last) 之外的部分
+  auto shift = static_cast<std::ptrdiff_t>(tokens.size()) -
+               static_cast<std::ptrdiff_t>(_token_count);
+  // 从包含第一个新 token 的语句开始，前面的语句不受影响
+  auto k = static_cast<std::size_t>(
+      std::upper_bound(_statements.begin(), _statements.end(), first,
+                       [](std::size_t t, const StatementCache &s) {
+                         return t < s.token;
+                       }) -
+      _statements.begin());
+  if (k > 0) k--;
+  // 回到第 k 个语句之前的符号表
+  auto init_begin = std::lower_bound(
+      _initializing.begin(), _initializing.end(), k,
+      [](const std::pair<std::size_t, std::string_view> &p, std::size_t i) {
+        return p.first < i;
+      });
+  decltype(_initializing) old_initializing(init_begin, _initializing.end(),
+                                           _initializing.get_allocator());
+  _initializing.erase(init_begin, _initializing.end());
+  for (auto &it : old_initializing) makeUninitialized(it.second);
+
+  // 新的语句和指令先放在单独的缓冲区里
+  decltype(_statements) statements(_statements.get_allocator());
+  std::vector<Instruction> instructions;
+  decltype(_initializing) initializing(_initializing.get_allocator());
+  std::swap(statements, _statements);
+  std::swap(instructions, _instructions);
+  std::swap(initializing, _initializing);
+  auto instruction_begin =
+      k < statements.size() ? statements[k].instruction : instructions.size();
+
+  _tokens = std::move(tokens);
+  _token_count = _tokens.size();
+  _errors.clear();
+  _max_errors = max_errors == 0 ? 1 : max_errors;
+  _offset = k < statements.size() ? statements[k].token : _declaration_end;
+  _current_pos = _offset == 0 ? 0 : _tokens[_offset - 1].GetEndOffset();
+  auto j = k;
+  auto old_init = old_initializing.begin();
+  bool synced = false;
+  while (true) {
+    // 越过新的 token 之后，如果和旧的语句从同一个 token 开始，并且符号表相同
+    // 那么之后的 token 和符号表都和上一次相同，分析的结果也相同
+    if (_offset >= last) {
+      auto old_token = static_cast<std::size_t>(_offset - shift);
+      while (j < statements.size() && statements[j].token < old_token) {
+        if (old_init != old_initializing.end() && old_init->first == j)
+          ++old_init;
+        j++;
+      }
+      bool boundary = j < statements.size() ? statements[j].token == old_token
+                                            : _sequence_end == old_token;
+      // 符号表只会增加已初始化的变量，所以只需比较这段语句初始化的变量
+      auto count = static_cast<std::size_t>(old_init -
+                                            old_initializing.begin());
+      if (boundary && count == _initializing.size() &&
+          std::all_of(old_initializing.begin(), old_init,
+                      [this](const auto &p) {
+                        return isInitializedVariable(p.second);
+                      })) {
+        synced = true;
+        break;
+      }
+    }
+    bool end;
+    auto err = analyseStatement(end);
+    if (err.has_value()) _errors.emplace_back(err.value());
+    if (!_errors.empty() || end) break;
+  }
+  if (synced) {
+    // 重新初始化之后的语句初始化的变量
+    for (auto it = old_init; it != old_initializing.end(); ++it)
+      makeInitialized(it->second);
+    _offset = static_cast<std::size_t>(_sequence_end + shift);
+  } else
+    j = statements.size();
+  // 检查 'end'，有错误时重新分析全部 token，以得到完全一致的错误
+  auto ed = _errors.empty() ? nextToken() : std::optional<Token>();
+  if (!ed.has_value() || ed.value().GetType() != TokenType::END) {
+    analyseAll(max_errors);
+    return _errors;
+  }
+  _sequence_end = _offset - 1;
+
+  // 把新的结果拼接到缓存中
+  auto instruction_end =
+      j < statements.size() ? statements[j].instruction : instructions.size();
+  auto instruction_shift = static_cast<std::ptrdiff_t>(_instructions.size()) -
+                           static_cast<std::ptrdiff_t>(instruction_end -
+                                                       instruction_begin);
+  auto statement_shift = static_cast<std::ptrdiff_t>(_statements.size()) -
+                         static_cast<std::ptrdiff_t>(j - k);
+  for (auto &it : _statements) it.instruction += instruction_begin;
+  for (auto &it : _initializing) it.first += k;
+  for (auto i = j; i < statements.size(); i++) {
+    statements[i].token += shift;
+    statements[i].instruction += instruction_shift;
+  }
+  for (auto it = old_init; it != old_initializing.end(); ++it)
+    _initializing.emplace_back(it->first + statement_shift, it->second);
+  splice(instructions, instruction_begin, instruction_end, _instructions);
+  splice(statements, k, j, _statements);
+  initializing.insert(initializing.end(), _initializing.begin(),
+                      _initializing.end());
+  std::swap(instructions, _instructions);
+  std::swap(statements, _statements);
+  std::swap(initializing, _initializing);
+  return _errors;
 }
 
 // <程序> ::= 'begin'<主过程>'end'
@@ -18,9 +185,13 @@ std::optional<CompilationError> Analyser::analyseProgram() {
 
   // 'begin'
   auto bg = nextToken();
-  if (!bg.has_value() || bg.value().GetType() != TokenType::BEGIN)
-    return std::make_optional<CompilationError>(_current_pos,
-                                                ErrorCode::ErrNoBegin);
+  if (!bg.has_value() || bg.value().GetType() != TokenType::BEGIN) {
+    auto err = CompilationError(_current_pos, ErrorCode::ErrNoBegin);
+    if (_errors.size() + 1 >= _max_errors) return err;
+    // 假装读到了 'begin'，这个 token 留给 <主过程>
+    _errors.emplace_back(err);
+    if (bg.has_value()) unreadToken();
+  }
 
   // <主过程>
   auto err = analyseMain();
@@ -31,19 +202,23 @@ std::optional<CompilationError> Analyser::analyseProgram() {
   if (!ed.has_value() || ed.value().GetType() != TokenType::END)
     return std::make_optional<CompilationError>(_current_pos,
                                                 ErrorCode::ErrNoEnd);
+  if (_ast) _ast->Finish(_tokens.front().GetStartOffset());
   return {};
 }
 
 // <主过程> ::= <常量声明><变量声明><语句序列>
-// 需要补全
 std::optional<CompilationError> Analyser::analyseMain() {
-  // 完全可以参照 <程序> 编写
-
   // <常量声明>
+  auto err = analyseConstantDeclaration();
+  if (err.has_value()) return err;
 
   // <变量声明>
+  err = analyseVariableDeclaration();
+  if (err.has_value()) return err;
 
   // <语句序列>
+  err = analyseStatementSequence();
+  if (err.has_value()) return err;
   return {};
 }
 
@@ -64,59 +239,104 @@ std::optional<CompilationError> Analyser::analyseConstantDeclaration() {
     }
 
     // <常量声明语句>
-    next = nextToken();
-    if (!next.has_value() || next.value().GetType() != TokenType::IDENTIFIER)
-      return std::make_optional<CompilationError>(_current_pos,
-                                                  ErrorCode::ErrNeedIdentifier);
-    if (isDeclared(next.value().GetValueString()))
-      return std::make_optional<CompilationError>(
-          _current_pos, ErrorCode::ErrDuplicateDeclaration);
-    addConstant(next.value());
+    auto start = _offset - 1;
+    auto err = analyseConstantDeclarationStatement();
+    if (err.has_value() && !recover(err.value(), start)) return err;
+  }
+  return {};
+}
 
-    // '='
-    next = nextToken();
-    if (!next.has_value() || next.value().GetType() != TokenType::EQUAL_SIGN)
-      return std::make_optional<CompilationError>(
-          _current_pos, ErrorCode::ErrConstantNeedValue);
+// <常量声明语句> 除去 'const' 的部分
+std::optional<CompilationError>
+Analyser::analyseConstantDeclarationStatement() {
+  auto offset = _tokens[_offset - 1].GetStartOffset();
+  // <标识符>
+  auto next = nextToken();
+  if (!next.has_value() || next.value().GetType() != TokenType::IDENTIFIER)
+    return std::make_optional<CompilationError>(_current_pos,
+                                                ErrorCode::ErrNeedIdentifier);
+  if (isDeclared(next.value().GetValueView()))
+    return std::make_optional<CompilationError>(
+        _current_pos, ErrorCode::ErrDuplicateDeclaration);
+  addConstant(next.value());
 
-    // <常表达式>
-    int32_t val;
-    auto err = analyseConstantExpression(val);
-    if (err.has_value()) return err;
+  // '='
+  next = nextToken();
+  if (!next.has_value() || next.value().GetType() != TokenType::EQUAL_SIGN)
+    return std::make_optional<CompilationError>(
+        _current_pos, ErrorCode::ErrConstantNeedValue);
 
-    // ';'
-    next = nextToken();
-    if (!next.has_value() || next.value().GetType() != TokenType::SEMICOLON)
-      return std::make_optional<CompilationError>(_current_pos,
-                                                  ErrorCode::ErrNoSemicolon);
-    // 生成一次 LIT 指令加载常量
-    _instructions.emplace_back(Operation::LIT, val);
-  }
+  // <常表达式>
+  int32_t val;
+  auto err = analyseConstantExpression(val);
+  if (err.has_value()) return err;
+
+  // ';'
+  next = nextToken();
+  if (!next.has_value() || next.value().GetType() != TokenType::SEMICOLON)
+    return std::make_optional<CompilationError>(_current_pos,
+                                                ErrorCode::ErrNoSemicolon);
+  // 生成一次 LIT 指令加载常量
+  _instructions.emplace_back(Operation::LIT, val);
+  if (_ast) _ast->AddConstDecl(val, offset);
   return {};
 }
 
 // <变量声明> ::= {<变量声明语句>}
 // <变量声明语句> ::= 'var'<标识符>['='<表达式>]';'
-// 需要补全
 std::optional<CompilationError> Analyser::analyseVariableDeclaration() {
-  // 变量声明语句可能有一个或者多个
-
-  // 预读？
+  // 变量声明语句可能有 0 或无数个
+  while (true) {
+    // 预读
+    auto next = nextToken();
+    if (!next.has_value()) return {};
+    // 'var'
+    if (next.value().GetType() != TokenType::VAR) {
+      unreadToken();
+      return {};
+    }
 
-  // 'var'
+    // <变量声明语句>
+    auto start = _offset - 1;
+    auto err = analyseVariableDeclarationStatement();
+    if (err.has_value() && !recover(err.value(), start)) return err;
+  }
+  return {};
+}
 
+// <变量声明语句> 除去 'var' 的部分
+std::optional<CompilationError>
+Analyser::analyseVariableDeclarationStatement() {
+  auto offset = _tokens[_offset - 1].GetStartOffset();
   // <标识符>
-  auto ident =
-      /*标识符的 token*/ Token(TokenType::NULL_TOKEN, nullptr, 0, 0, 0, 0);
+  auto next = nextToken();
+  if (!next.has_value() || next.value().GetType() != TokenType::IDENTIFIER)
+    return std::make_optional<CompilationError>(_current_pos,
+                                                ErrorCode::ErrNeedIdentifier);
+  if (isDeclared(next.value().GetValueView()))
+    return std::make_optional<CompilationError>(
+        _current_pos, ErrorCode::ErrDuplicateDeclaration);
+  auto ident = next.value();
 
   // 变量可能没有初始化，仍然需要一次预读
-  bool initialized = /*填写*/ false;
-
-  // '='
+  next = nextToken();
+  if (!next.has_value())
+    return std::make_optional<CompilationError>(_current_pos,
+                                                ErrorCode::ErrNoSemicolon);
+  bool initialized = next.value().GetType() == TokenType::EQUAL_SIGN;
 
-  // '<表达式>'
+  if (initialized) {
+    // '<表达式>'
+    auto err = analyseExpression();
+    if (err.has_value()) return err;
+  } else
+    unreadToken();
 
   // ';'
+  next = nextToken();
+  if (!next.has_value() || next.value().GetType() != TokenType::SEMICOLON)
+    return std::make_optional<CompilationError>(_current_pos,
+                                                ErrorCode::ErrNoSemicolon);
 
   // 把变量加入符号表
   if (initialized) {
@@ -127,91 +347,229 @@ std::optional<CompilationError> Analyser::analyseVariableDeclaration() {
     // 加载一个任意的初始值
     _instructions.emplace_back(Operation::LIT, 0);
   }
+  if (_ast) _ast->AddVarDecl(initialized, offset);
 
   return {};
 }
 
 // <语句序列> ::= {<语句>}
+std::optional<CompilationError> Analyser::analyseStatementSequence() {
+  _declaration_end = _offset;
+  bool end = false;
+  while (!end) {
+    auto err = analyseStatement(end);
+    if (err.has_value()) return err;
+  }
+  _sequence_end = _offset;
+  return {};
+}
+
 // <语句> :: = <赋值语句> | <输出语句> | <空语句>
 // <赋值语句> :: = <标识符>'='<表达式>';'
 // <输出语句> :: = 'print' '(' <表达式> ')' ';'
 // <空语句> :: = ';'
-// 需要补全
-std::optional<CompilationError> Analyser::analyseStatementSequence() {
-  while (true) {
-    // 预读
-    auto next = nextToken();
-    if (!next.has_value()) return {};
-    unreadToken();
-    if (next.value().GetType() != TokenType::IDENTIFIER &&
-        next.value().GetType() != TokenType::PRINT &&
-        next.value().GetType() != TokenType::SEMICOLON) {
-      return {};
-    }
-    std::optional<CompilationError> err;
-    switch (next.value().GetType()) {
-        // 这里需要你针对不同的预读结果来调用不同的子程序
-        // 注意我们没有针对空语句单独声明一个函数，因此可以直接在这里返回
-      default:
-        break;
-    }
+std::optional<CompilationError> Analyser::analyseStatement(bool &end) {
+  end = false;
+  // 预读
+  auto next = nextToken();
+  if (!next.has_value()) {
+    end = true;
+    return {};
+  }
+  unreadToken();
+  auto start = _offset;
+  if (next.value().GetType() != TokenType::IDENTIFIER &&
+      next.value().GetType() != TokenType::PRINT &&
+      next.value().GetType() != TokenType::SEMICOLON) {
+    // 不能开始一个语句的 token，<程序> 会因为缺少 'end' 报错
+    // 恢复时就地报告这个错误，然后跳过它继续分析
+    if (next.value().GetType() == TokenType::END ||
+        !recover(CompilationError(_current_pos, ErrorCode::ErrNoEnd), start))
+      end = true;
+    return {};
+  }
+  // 记录增量分析的缓存
+  if (_incremental) _statements.push_back({start, _instructions.size()});
+  auto uninitialized = _uninitialized_vars.size();
+  std::optional<CompilationError> err;
+  switch (next.value().GetType()) {
+    case TokenType::IDENTIFIER:
+      err = analyseAssignmentStatement();
+      break;
+    case TokenType::PRINT:
+      err = analyseOutputStatement();
+      break;
+    // 注意我们没有针对空语句单独声明一个函数，因此可以直接在这里处理
+    case TokenType::SEMICOLON:
+      nextToken();
+      break;
+    default:
+      break;
   }
+  if (err.has_value() && !recover(err.value(), start)) return err;
+  if (_incremental && _uninitialized_vars.size() != uninitialized)
+    _initializing.emplace_back(
+        _statements.size() - 1,
+        _vars.find(_tokens[start].GetValueView())->first);
   return {};
 }
 
 // <常表达式> ::= [<符号>]<无符号整数>
-// 需要补全
 std::optional<CompilationError> Analyser::analyseConstantExpression(
     int32_t &out) {
-  // out 是常表达式的结果，算出结果给 out 赋值就行
-  // 这里你要分析常表达式并且计算结果
   // 注意以下均为常表达式
   // +1 -1 1
-  // 同时要注意是否溢出
+  // [<符号>]
+  auto next = nextToken();
+  int32_t prefix = 1;
+  if (!next.has_value())
+    return std::make_optional<CompilationError>(
+        _current_pos, ErrorCode::ErrIncompleteExpression);
+  if (next.value().GetType() == TokenType::PLUS_SIGN)
+    prefix = 1;
+  else if (next.value().GetType() == TokenType::MINUS_SIGN)
+    prefix = -1;
+  else
+    unreadToken();
+
+  // <无符号整数>
+  // 溢出已经在词法分析时检查过了，而且 -INT_MAX 不会溢出
+  next = nextToken();
+  if (!next.has_value() ||
+      next.value().GetType() != TokenType::UNSIGNED_INTEGER)
+    return std::make_optional<CompilationError>(
+        _current_pos, ErrorCode::ErrIncompleteExpression);
+  out = prefix * std::any_cast<int32_t>(next.value().GetValue());
   return {};
 }
 
 // <表达式> ::= <项>{<加法型运算符><项>}
+// <项> ::= <因子>{<乘法型运算符><因子>}
+// <因子> ::= [<符号>]( <标识符> | <无符号整数> | '('<表达式>')' )
+// 按文法递归下降时每一层括号都要递归一次，嵌套很深的输入会耗尽栈空间
+// 这里用一个显式的栈做算符优先分析，所有的 <项> 和 <因子> 都在这里处理
+// 读取 token 和生成指令的顺序都和递归下降完全相同，所以错误的位置也相同
 std::optional<CompilationError> Analyser::analyseExpression() {
-  // <项>
-  auto err = analyseItem();
-  if (err.has_value()) return err;
-
-  // {<加法型运算符><项>}
+  _pending.clear();
   while (true) {
-    // 预读
+    // 读一个 <因子>，遇到 '(' 时继续读括号中的第一个 <因子>
+
+    // [<符号>]
     auto next = nextToken();
-    if (!next.has_value()) return {};
+    if (!next.has_value())
+      return std::make_optional<CompilationError>(
+          _current_pos, ErrorCode::ErrIncompleteExpression);
     auto type = next.value().GetType();
-    if (type != TokenType::PLUS_SIGN && type != TokenType::MINUS_SIGN) {
-      unreadToken();
-      return {};
+    if (type == TokenType::PLUS_SIGN || type == TokenType::MINUS_SIGN) {
+      if (type == TokenType::MINUS_SIGN) {
+        _pending.push_back(
+            {Pending::Negate, ILL, next.value().GetStartOffset()});
+        _instructions.emplace_back(Operation::LIT, 0);
+      }
+      next = nextToken();
+      if (!next.has_value())
+        return std::make_optional<CompilationError>(
+            _current_pos, ErrorCode::ErrIncompleteExpression);
     }
 
-    // <项>
-    err = analyseItem();
-    if (err.has_value()) return err;
+    switch (next.value().GetType()) {
+      // 加载变量
+      case TokenType::IDENTIFIER: {
+        auto ident = next.value().GetValueView();
+        if (!isDeclared(ident))
+          return {CompilationError(_current_pos, ErrorCode::ErrNotDeclared)};
+        if (!isInitializedVariable(ident) && !isConstant(ident))
+          return {
+              CompilationError(_current_pos, ErrorCode::ErrNotInitialized)};
+        _instructions.emplace_back(Operation::LOD, getIndex(ident));
+        if (_ast)
+          _ast->PushVariable(getIndex(ident), next.value().GetStartOffset());
+        break;
+      }
+      // 加载常数
+      case TokenType::UNSIGNED_INTEGER: {
+        int32_t val = std::any_cast<int32_t>(next.value().GetValue());
+        _instructions.emplace_back(Operation::LIT, val);
+        if (_ast) _ast->PushLiteral(val, next.value().GetStartOffset());
+        break;
+      }
+      // '('<表达式>')'
+      case TokenType::LEFT_BRACKET:
+        _pending.push_back({Pending::Bracket, ILL, 0});
+        continue;
+      default:
+        return std::make_optional<CompilationError>(
+            _current_pos, ErrorCode::ErrIncompleteExpression);
+    }
 
-    // 根据结果生成指令
-    if (type == TokenType::PLUS_SIGN)
-      _instructions.emplace_back(Operation::ADD, 0);
-    else if (type == TokenType::MINUS_SIGN)
-      _instructions.emplace_back(Operation::SUB, 0);
+    // 一个 <因子> 结束了，它可能同时结束了外层的若干个括号
+    while (true) {
+      // 取负
+      if (!_pending.empty() && _pending.back().kind == Pending::Negate) {
+        _instructions.emplace_back(Operation::SUB, 0);
+        if (_ast) _ast->ApplyNegate(_pending.back().offset);
+        _pending.pop_back();
+      }
+
+      // 预读
+      next = nextToken();
+      type = next.has_value() ? next.value().GetType() : TokenType::NULL_TOKEN;
+      // <乘法型运算符> 结束了前一个 <因子>
+      // <加法型运算符> 结束了前一个 <项>
+      // 其他 token 结束了这一层的 <表达式>
+      auto multiplicative = type == TokenType::MULTIPLICATION_SIGN ||
+                            type == TokenType::DIVISION_SIGN;
+      auto additive =
+          type == TokenType::PLUS_SIGN || type == TokenType::MINUS_SIGN;
+      // 根据结果生成指令
+      while (!_pending.empty() && _pending.back().kind == Pending::Binary) {
+        auto op = _pending.back().op;
+        if (multiplicative && op != Operation::MUL && op != Operation::DIV)
+          break;
+        _instructions.emplace_back(op, 0);
+        if (_ast) _ast->ApplyBinary(op, _pending.back().offset);
+        _pending.pop_back();
+      }
+      if (multiplicative || additive) {
+        Operation op;
+        if (type == TokenType::MULTIPLICATION_SIGN)
+          op = Operation::MUL;
+        else if (type == TokenType::DIVISION_SIGN)
+          op = Operation::DIV;
+        else if (type == TokenType::PLUS_SIGN)
+          op = Operation::ADD;
+        else
+          op = Operation::SUB;
+        _pending.push_back(
+            {Pending::Binary, op, next.value().GetStartOffset()});
+        break;
+      }
+
+      // 最外层的 <表达式> 结束了
+      if (_pending.empty()) {
+        if (next.has_value()) unreadToken();
+        return {};
+      }
+      // 括号中的 <表达式> 结束了，之后是 ')'
+      if (type != TokenType::RIGHT_BRACKET)
+        return std::make_optional<CompilationError>(
+            _current_pos, ErrorCode::ErrIncompleteExpression);
+      _pending.pop_back();
+    }
   }
   return {};
 }
 
 // <赋值语句> ::= <标识符>'='<表达式>';'
-// 需要补全
 std::optional<CompilationError> Analyser::analyseAssignmentStatement() {
   // 这里除了语法分析以外还要留意
   // 标识符声明过吗？
   // 标识符是常量吗？
   // 需要生成指令吗？
 
-  auto ident =
-      /*标识符的 token*/ Token(TokenType::NULL_TOKEN, nullptr, 0, 0, 0, 0);
-  auto name = ident.GetValueString();
+  // 如果之前 <语句序列> 的实现正确，这里一定是标识符
+  auto ident = nextToken().value();
+  auto name = ident.GetValueView();
   // 未定义
   if (!isDeclared(name)) {
     return {CompilationError(_current_pos, ErrorCode::ErrNotDeclared)};
@@ -220,9 +578,27 @@ std::optional<CompilationError> Analyser::analyseAssignmentStatement() {
   if (isConstant(name)) {
     return {CompilationError(_current_pos, ErrorCode::ErrAssignToConstant)};
   }
+
+  // '='
+  auto next = nextToken();
+  if (!next.has_value() || next.value().GetType() != TokenType::EQUAL_SIGN)
+    return std::make_optional<CompilationError>(
+        _current_pos, ErrorCode::ErrInvalidAssignment);
+
+  // <表达式>
+  auto err = analyseExpression();
+  if (err.has_value()) return err;
+
+  // ';'
+  next = nextToken();
+  if (!next.has_value() || next.value().GetType() != TokenType::SEMICOLON)
+    return std::make_optional<CompilationError>(_current_pos,
+                                                ErrorCode::ErrNoSemicolon);
+
   // 存储这个标识符
   auto index = getIndex(name);
   _instructions.emplace_back(Operation::STO, index);
+  if (_ast) _ast->AddAssign(index, ident.GetStartOffset());
   if (!isInitializedVariable(name)) makeInitialized(name);
   return {};
 }
@@ -231,6 +607,7 @@ std::optional<CompilationError> Analyser::analyseAssignmentStatement() {
 std::optional<CompilationError> Analyser::analyseOutputStatement() {
   // 如果之前 <语句序列> 的实现正确，这里第一个 next 一定是 TokenType::PRINT
   auto next = nextToken();
+  auto offset = next.value().GetStartOffset();
 
   // '('
   next = nextToken();
@@ -256,100 +633,89 @@ std::optional<CompilationError> Analyser::analyseOutputStatement() {
 
   // 生成相应的指令 WRT
   _instructions.emplace_back(Operation::WRT, 0);
-  return {};
-}
-
-// <项> :: = <因子>{ <乘法型运算符><因子> }
-// 需要补全
-std::optional<CompilationError> Analyser::analyseItem() {
-  // 可以参考 <表达式> 实现
-
-  // <因子>
-
-  // { <乘法型运算符><因子> }
-  while (true) {
-    // 预读
-
-    auto type = TokenType::NULL_TOKEN;
-
-    // <因子>
-
-    // 根据结果生成指令
-    if (type == TokenType::MULTIPLICATION_SIGN)
-      _instructions.emplace_back(Operation::MUL, 0);
-    else if (type == TokenType::DIVISION_SIGN)
-      _instructions.emplace_back(Operation::DIV, 0);
-  }
-}
-
-// <因子> ::= [<符号>]( <标识符> | <无符号整数> | '('<表达式>')' )
-// 需要补全
-std::optional<CompilationError> Analyser::analyseFactor() {
-  // [<符号>]
-  auto next = nextToken();
-  auto prefix = 1;
-  if (!next.has_value())
-    return std::make_optional<CompilationError>(
-        _current_pos, ErrorCode::ErrIncompleteExpression);
-  if (next.value().GetType() == TokenType::PLUS_SIGN)
-    prefix = 1;
-  else if (next.value().GetType() == TokenType::MINUS_SIGN) {
-    prefix = -1;
-    _instructions.emplace_back(Operation::LIT, 0);
-  } else
-    unreadToken();
-
-  // 预读
-  next = nextToken();
-  if (!next.has_value())
-    return std::make_optional<CompilationError>(
-        _current_pos, ErrorCode::ErrIncompleteExpression);
-  switch (next.value().GetType()) {
-    // 这里和 <语句序列> 类似，需要根据预读结果调用不同的子程序
-    // 但是要注意 default 返回的是一个编译错误
-
-    // 备用代码：
-    //
-    // - 加载变量
-    // auto ident = /* 变量名 */;
-    // if (!isDeclared(ident))
-    //   return {CompilationError(_current_pos, ErrorCode::ErrNotDeclared)};
-    // if (!isInitializedVariable(ident) && !isConstant(ident))
-    //   return {CompilationError(_current_pos,
-    //   ErrorCode::ErrNotInitialized)};
-    // _instructions.emplace_back(Operation::LOD, getIndex(ident));
-    //
-    // - 加载常数
-    // int32_t val = /* 值 */;
-    // _instructions.emplace_back(Operation::LIT, val);
-    default:
-      return std::make_optional<CompilationError>(
-          _current_pos, ErrorCode::ErrIncompleteExpression);
-  }
-
-  // 取负
-  if (prefix == -1) _instructions.emplace_back(Operation::SUB, 0);
+  if (_ast) _ast->AddPrint(offset);
   return {};
 }
 
 std::optional<Token> Analyser::nextToken() {
   if (_offset == _tokens.size()) return {};
   // 考虑到 _tokens[0..._offset-1] 已经被分析过了
-  // 所以我们选择 _tokens[0..._offset-1] 的 EndPos 作为当前位置
-  _current_pos = _tokens[_offset].GetEndPos();
+  // 所以我们选择 _tokens[0..._offset-1] 的结束偏移作为当前位置
+  _current_pos = _tokens[_offset].GetEndOffset();
   return _tokens[_offset++];
 }
 
 void Analyser::unreadToken() {
   if (_offset == 0) DieAndPrint("analyser unreads token from the begining.");
-  _current_pos = _tokens[_offset - 1].GetEndPos();
+  _current_pos = _tokens[_offset - 1].GetEndOffset();
   _offset--;
 }
 
-void Analyser::_add(const Token &tk, std::map<std::string, int32_t> &mp) {
+void Analyser::reset() {
+  _offset = 0;
+  _instructions.clear();
+  _current_pos = 0;
+  _uninitialized_vars.clear();
+  _vars.clear();
+  _consts.clear();
+  _nextTokenIndex = 0;
+  _errors.clear();
+  _cached = false;
+  _token_count = _tokens.size();
+  _declaration_end = 0;
+  _sequence_end = 0;
+  _statements.clear();
+  _initializing.clear();
+  if (_ast) _ast->Clear();
+}
+
+void Analyser::analyseAll(std::size_t max_errors) {
+  MINIPLC0_TIME_SCOPE("syntactic analysis");
+  reset();
+  _max_errors = max_errors == 0 ? 1 : max_errors;
+  auto err = analyseProgram();
+  // 最后一个不能恢复的错误由递归子程序直接返回
+  if (err.has_value()) _errors.emplace_back(err.value());
+  _cached = _incremental && _errors.empty();
+  if (!_errors.empty()) _instructions.clear();
+}
+
+bool Analyser::recover(const CompilationError &err, std::size_t start) {
+  // 最后一个错误留给调用者返回
+  if (_errors.size() + 1 >= _max_errors) return false;
+  _errors.emplace_back(err);
+  synchronize(start);
+  return true;
+}
+
+// 每次恢复至少读走一个 token，所以整个分析仍然是线性的
+void Analyser::synchronize(std::size_t start) {
+  auto is_keyword = [](TokenType type) {
+    return type == TokenType::END || type == TokenType::CONST ||
+           type == TokenType::VAR;
+  };
+  if (_offset > start) {
+    // 出错的 token 可能已经被读走了
+    auto type = _tokens[_offset - 1].GetType();
+    if (type == TokenType::SEMICOLON) return;
+    if (_offset - 1 > start && is_keyword(type)) {
+      unreadToken();
+      return;
+    }
+  } else if (_offset < _tokens.size())
+    nextToken();
+  while (_offset < _tokens.size()) {
+    auto type = _tokens[_offset].GetType();
+    if (is_keyword(type)) return;
+    nextToken();
+    if (type == TokenType::SEMICOLON) return;
+  }
+}
+
+void Analyser::_add(const Token &tk, SymbolTable &mp) {
   if (tk.GetType() != TokenType::IDENTIFIER)
     DieAndPrint("only identifier can be added to the table.");
-  mp[tk.GetValueString()] = _nextTokenIndex;
+  mp.emplace(tk.GetValueView(), _nextTokenIndex);
   _nextTokenIndex++;
 }
 
@@ -361,7 +727,7 @@ void Analyser::addUninitializedVariable(const Token &tk) {
   _add(tk, _uninitialized_vars);
 }
 
-void Analyser::makeInitialized(const std::string &var_name) {
+void Analyser::makeInitialized(std::string_view var_name) {
   auto var = _uninitialized_vars.find(var_name);
   if (var == _uninitialized_vars.end())
     DieAndPrint("Variable not found in uninitialized area. bad bad");
@@ -369,28 +735,37 @@ void Analyser::makeInitialized(const std::string &var_name) {
   _vars.insert(std::move(item));
 }
 
-int32_t Analyser::getIndex(const std::string &s) {
-  if (_uninitialized_vars.find(s) != _uninitialized_vars.end())
-    return _uninitialized_vars[s];
-  else if (_vars.find(s) != _vars.end())
-    return _vars[s];
-  else
-    return _consts[s];
+void Analyser::makeUninitialized(std::string_view var_name) {
+  auto var = _vars.find(var_name);
+  if (var == _vars.end())
+    DieAndPrint("Variable not found in initialized area. bad bad");
+  auto item = _vars.extract(var);
+  _uninitialized_vars.insert(std::move(item));
+}
+
+int32_t Analyser::getIndex(std::string_view s) {
+  auto it = _uninitialized_vars.find(s);
+  if (it != _uninitialized_vars.end()) return it->second;
+  it = _vars.find(s);
+  if (it != _vars.end()) return it->second;
+  it = _consts.find(s);
+  if (it == _consts.end()) DieAndPrint("getIndex() of an undeclared name.");
+  return it->second;
 }
 
-bool Analyser::isDeclared(const std::string &s) {
+bool Analyser::isDeclared(std::string_view s) {
   return isConstant(s) || isUninitializedVariable(s) ||
          isInitializedVariable(s);
 }
 
-bool Analyser::isUninitializedVariable(const std::string &s) {
+bool Analyser::isUninitializedVariable(std::string_view s) {
   return _uninitialized_vars.find(s) != _uninitialized_vars.end();
 }
-bool Analyser::isInitializedVariable(const std::string &s) {
+bool Analyser::isInitializedVariable(std::string_view s) {
   return _vars.find(s) != _vars.end();
 }
 
-bool Analyser::isConstant(const std::string &s) {
+bool Analyser::isConstant(std::string_view s) {
   return _consts.find(s) != _consts.end();
 }
 }  // namespace miniplc0
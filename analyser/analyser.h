@@ -2,11 +2,16 @@
 
 #include <cstddef>  // for std::size_t
 #include <cstdint>
+#include <functional>
 #include <map>
+#include <memory_resource>
 #include <optional>
+#include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
+#include "ast/ast.h"
 #include "error/error.h"
 #include "instruction/instruction.h"
 #include "tokenizer/token.h"
@@ -20,23 +25,75 @@ class Analyser final {
   using uint32_t = std::uint32_t;
   using int32_t = std::int32_t;
 
+  // 符号表：名字到栈上的偏移，可以直接用 std::string_view 查找
+  using SymbolTable =
+      std::pmr::map<std::pmr::string, int32_t, std::less<>>;
+
+ public:
+  // 一次最多收集的错误个数，防止病态的输入耗尽内存
+  static constexpr std::size_t kMaxErrors = 100;
+
  public:
-  Analyser(std::vector<Token> v)
+  // 符号表和增量分析的缓存从 resource 分配，通常是这次编译的 Arena
+  Analyser(std::vector<Token> v, std::pmr::memory_resource *resource =
+                                     std::pmr::get_default_resource())
       : _tokens(std::move(v)),
         _offset(0),
         _instructions({}),
-        _current_pos(0, 0),
-        _uninitialized_vars({}),
-        _vars({}),
-        _consts({}),
-        _nextTokenIndex(0) {}
+        _current_pos(0),
+        _uninitialized_vars(resource),
+        _vars(resource),
+        _consts(resource),
+        _nextTokenIndex(0),
+        _errors({}),
+        _max_errors(1),
+        _ast(nullptr),
+        _pending(resource),
+        _incremental(false),
+        _cached(false),
+        _token_count(0),
+        _declaration_end(0),
+        _sequence_end(0),
+        _statements(resource),
+        _initializing(resource) {}
   Analyser(Analyser &&) = delete;
   Analyser(const Analyser &) = delete;
   Analyser &operator=(Analyser) = delete;
 
-  // 唯一接口
+  // 遇到第一个错误就停止
   std::pair<std::vector<Instruction>, std::optional<CompilationError>>
   Analyse();
+  // 遇到错误后跳到下一个同步点继续分析，最多收集 max_errors 个错误
+  // 第一个错误和 Analyse() 返回的完全一致
+  // 只要有错误，返回的指令就是空的
+  std::pair<std::vector<Instruction>, std::vector<CompilationError>>
+  AnalyseWithRecovery(std::size_t max_errors = kMaxErrors);
+  // 和 AnalyseWithRecovery() 相同，同时构造语法树，有错误时语法树是空的
+  // 指令可以由 GenerateCode() 从语法树生成
+  std::pair<Ast, std::vector<CompilationError>> AnalyseToAst(
+      std::size_t max_errors = kMaxErrors);
+  // 增量分析：tokens 是编辑之后的全部 token，其中 [first, last) 是新的 token
+  // 其余的 token 和上一次分析的相同，只是偏移不同，见 Tokenizer::Retokenize()
+  // 声明没有变化时只从包含第一个新 token 的语句开始重新分析
+  // 直到和上一次的结果重新同步，之后的语句直接复用缓存的指令
+  // 上一次分析有错误时，或者这一次有错误时，会重新分析全部 token
+  // 只有调用过 Reanalyse() 之后才记录缓存，所以第一次调用会分析全部 token
+  // 返回的错误和 AnalyseWithRecovery(max_errors) 完全一致
+  // 生成的指令见 GetInstructions()
+  std::vector<CompilationError> Reanalyse(std::vector<Token> tokens,
+                                          std::size_t first, std::size_t last,
+                                          std::size_t max_errors = kMaxErrors);
+  // 最近一次分析生成的指令，有错误时是空的
+  const std::vector<Instruction> &GetInstructions() const {
+    return _instructions;
+  }
+  // 交还 token，避免增量分析时复制全部 token，缓存仍然有效
+  // 下一次 Reanalyse() 的 tokens 应该由它编辑得到
+  std::vector<Token> ReleaseTokens() { return std::move(_tokens); }
+  // 最近一次分析声明的常量和变量的个数
+  std::size_t GetSymbolCount() const {
+    return static_cast<std::size_t>(_nextTokenIndex);
+  }
 
  private:
   // 所有的递归子程序
@@ -47,23 +104,26 @@ class Analyser final {
   std::optional<CompilationError> analyseMain();
   // <常量声明>
   std::optional<CompilationError> analyseConstantDeclaration();
+  // <常量声明语句>
+  std::optional<CompilationError> analyseConstantDeclarationStatement();
   // <变量声明>
   std::optional<CompilationError> analyseVariableDeclaration();
+  // <变量声明语句>
+  std::optional<CompilationError> analyseVariableDeclarationStatement();
   // <语句序列>
   std::optional<CompilationError> analyseStatementSequence();
+  // <语句>
+  // 这里的 end 说明 <语句序列> 已经结束了
+  std::optional<CompilationError> analyseStatement(bool &end);
   // <常表达式>
   // 这里的 out 是常表达式的值
   std::optional<CompilationError> analyseConstantExpression(int32_t &out);
-  // <表达式>
+  // <表达式>，同时处理其中的 <项> 和 <因子>
   std::optional<CompilationError> analyseExpression();
   // <赋值语句>
   std::optional<CompilationError> analyseAssignmentStatement();
   // <输出语句>
   std::optional<CompilationError> analyseOutputStatement();
-  // <项>
-  std::optional<CompilationError> analyseItem();
-  // <因子>
-  std::optional<CompilationError> analyseFactor();
 
   // Token 缓冲区相关操作
 
@@ -72,42 +132,100 @@ class Analyser final {
   // 回退一个 token
   void unreadToken();
 
+  // 下面是增量分析相关操作
+
+  // 清空上一次分析的全部结果
+  void reset();
+  // 分析全部 token，结果留在 _instructions 和 _errors 中
+  void analyseAll(std::size_t max_errors);
+
+  // 下面是错误恢复相关操作
+
+  // 记录一个错误并跳到下一个同步点，返回 false 说明不能再恢复了
+  // 此时调用者应该直接返回这个错误
+  // start 是出错的语句的第一个 token 的下标
+  bool recover(const CompilationError &, std::size_t start);
+  // 跳过 token 直到 ';'（会被读走）或者 'end' 'const' 'var'（不会被读走）
+  void synchronize(std::size_t start);
+
   // 下面是符号表相关操作
 
   // helper function
-  void _add(const Token &, std::map<std::string, int32_t> &);
+  void _add(const Token &, SymbolTable &);
   // 添加变量、常量、未初始化的变量
   void addVariable(const Token &);
   void addConstant(const Token &);
   void addUninitializedVariable(const Token &);
   // 将变量改为已声明
-  void makeInitialized(const std::string &var_name);
+  void makeInitialized(std::string_view var_name);
+  // 将变量改回未初始化，用于增量分析时回到之前的状态
+  void makeUninitialized(std::string_view var_name);
   // 是否被声明过
-  bool isDeclared(const std::string &);
+  bool isDeclared(std::string_view);
   // 是否是未初始化的变量
-  bool isUninitializedVariable(const std::string &);
+  bool isUninitializedVariable(std::string_view);
   // 是否是已初始化的变量
-  bool isInitializedVariable(const std::string &);
+  bool isInitializedVariable(std::string_view);
   // 是否是常量
-  bool isConstant(const std::string &);
+  bool isConstant(std::string_view);
   // 获得 {变量，常量} 在栈上的偏移
-  int32_t getIndex(const std::string &);
+  int32_t getIndex(std::string_view);
 
  private:
   std::vector<Token> _tokens;
   std::size_t _offset;
   std::vector<Instruction> _instructions;
-  std::pair<uint64_t, uint64_t> _current_pos;
+  // 当前位置在源代码中的偏移
+  uint32_t _current_pos;
 
   // 为了简单处理，我们直接把符号表耦合在语法分析里
   // 变量                   示例
   // _uninitialized_vars    var a;
   // _vars                  var a=1;
   // _consts                const a=1;
-  std::map<std::string, int32_t> _uninitialized_vars;
-  std::map<std::string, int32_t> _vars;
-  std::map<std::string, int32_t> _consts;
+  SymbolTable _uninitialized_vars;
+  SymbolTable _vars;
+  SymbolTable _consts;
   // 下一个 token 在栈的偏移
   int32_t _nextTokenIndex;
+
+  // 已经恢复过的错误
+  std::vector<CompilationError> _errors;
+  std::size_t _max_errors;
+
+  // 不为空时，生成指令的同时构造语法树
+  Ast *_ast;
+
+  // <表达式> 中还没有处理完的部分，作为 analyseExpression() 的显式栈
+  // Binary 是还没有生成指令的运算符，Negate 是还没有生成 SUB 的取负
+  // Bracket 是还没有遇到 ')' 的 '('
+  struct Pending {
+    enum Kind : std::uint8_t { Binary, Negate, Bracket } kind;
+    Operation op;
+    // 运算符或者符号在源代码中的偏移
+    uint32_t offset;
+  };
+  std::pmr::vector<Pending> _pending;
+
+  // 增量分析的缓存，只有上一次分析没有错误时才有效
+  // 语句之间只有变量的初始化会改变符号表，所以只记录哪些语句初始化了变量
+  // 只分析一次时不需要缓存，第一次 Reanalyse() 之后才开始记录
+  struct StatementCache {
+    // 语句的第一个 token 的下标
+    std::size_t token;
+    // 语句生成的第一条指令的下标
+    std::size_t instruction;
+  };
+  bool _incremental;
+  bool _cached;
+  // 上一次分析的 token 个数，ReleaseTokens() 之后仍然需要
+  std::size_t _token_count;
+  // <语句序列> 开始和结束的 token 的下标
+  std::size_t _declaration_end;
+  std::size_t _sequence_end;
+  std::pmr::vector<StatementCache> _statements;
+  // <初始化了变量的语句的下标，变量名>，下标递增
+  // 变量名指向符号表中的键，符号表的节点在分析结束前不会被释放
+  std::pmr::vector<std::pair<std::size_t, std::string_view>> _initializing;
 };
 }  // namespace miniplc0
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+#include "error/error.h"
+#include "instruction/instruction.h"
+
+namespace miniplc0 {
+
+// 抽象语法树
+// 所有结点都放在一个数组里，孩子用 32 位的下标表示而不是指针
+// 数组从 memory_resource 分配，通常是这次编译的 Arena
+//
+// 结点         value           lhs             rhs
+// Program      -               第一个语句      -
+// ConstDecl    常量的值        -               下一个语句
+// VarDecl      -               初始值或 kNone  下一个语句
+// Assign       栈上的偏移      表达式          下一个语句
+// Print        -               表达式          下一个语句
+// Literal      常数            -               -
+// Variable     栈上的偏移      -               -
+// Negate       -               操作数          -
+// Binary       -               左操作数        右操作数
+//
+// 空语句不生成结点，括号也不生成结点
+class Ast final {
+ private:
+  using int32_t = std::int32_t;
+  using uint32_t = std::uint32_t;
+
+ public:
+  // 没有孩子
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  enum class Kind : std::uint8_t {
+    Program,
+    ConstDecl,
+    VarDecl,
+    Assign,
+    Print,
+    Literal,
+    Variable,
+    Negate,
+    Binary
+  };
+
+  struct Node {
+    Kind kind;
+    // Binary 的运算，ADD SUB MUL DIV 之一
+    Operation op;
+    int32_t value;
+    // 结点对应的 token 在源代码中的偏移，语句是它的第一个 token
+    uint32_t offset;
+    uint32_t lhs;
+    uint32_t rhs;
+  };
+
+ public:
+  explicit Ast(std::pmr::memory_resource *resource =
+                   std::pmr::get_default_resource())
+      : _nodes(resource),
+        _operands(resource),
+        _root(kNone),
+        _first(kNone),
+        _last(kNone) {}
+
+  // 语法树的根，也就是 Program 结点，还没有完成时是 kNone
+  uint32_t GetRoot() const { return _root; }
+  const Node &GetNode(uint32_t index) const { return _nodes[index]; }
+  // 用于优化时修改语法树，见 ast/optimizer.h
+  Node &GetNode(uint32_t index) { return _nodes[index]; }
+  std::size_t NodeCount() const { return _nodes.size(); }
+
+  // 下面是构造语法树的操作，调用的顺序和生成指令的顺序相同
+  // 表达式是后缀的顺序，所以操作数的结点通过一个栈传递
+
+  void PushLiteral(int32_t value, uint32_t offset) {
+    _operands.emplace_back(
+        add({Kind::Literal, ILL, value, offset, kNone, kNone}));
+  }
+  void PushVariable(int32_t index, uint32_t offset) {
+    _operands.emplace_back(
+        add({Kind::Variable, ILL, index, offset, kNone, kNone}));
+  }
+  void ApplyNegate(uint32_t offset) {
+    auto operand = pop();
+    _operands.emplace_back(
+        add({Kind::Negate, ILL, 0, offset, operand, kNone}));
+  }
+  void ApplyBinary(Operation op, uint32_t offset) {
+    auto rhs = pop();
+    auto lhs = pop();
+    _operands.emplace_back(add({Kind::Binary, op, 0, offset, lhs, rhs}));
+  }
+  void AddConstDecl(int32_t value, uint32_t offset) {
+    addStatement({Kind::ConstDecl, ILL, value, offset, kNone, kNone});
+  }
+  void AddVarDecl(bool initialized, uint32_t offset) {
+    auto init = initialized ? pop() : kNone;
+    addStatement({Kind::VarDecl, ILL, 0, offset, init, kNone});
+  }
+  void AddAssign(int32_t index, uint32_t offset) {
+    auto expr = pop();
+    addStatement({Kind::Assign, ILL, index, offset, expr, kNone});
+  }
+  void AddPrint(uint32_t offset) {
+    auto expr = pop();
+    addStatement({Kind::Print, ILL, 0, offset, expr, kNone});
+  }
+  // 清空整棵树，用于重新分析
+  void Clear() {
+    _nodes.clear();
+    _operands.clear();
+    _root = _first = _last = kNone;
+  }
+  // 所有语句都已经加入，生成 Program 结点
+  void Finish(uint32_t offset) {
+    _root = add({Kind::Program, ILL, 0, offset, _first, kNone});
+  }
+
+ private:
+  uint32_t add(const Node &node) {
+    if (_nodes.size() >= kNone) DieAndPrint("too many AST nodes.");
+    auto index = static_cast<uint32_t>(_nodes.size());
+    _nodes.emplace_back(node);
+    return index;
+  }
+  uint32_t pop() {
+    if (_operands.empty()) DieAndPrint("AST operand stack underflow.");
+    auto index = _operands.back();
+    _operands.pop_back();
+    return index;
+  }
+  void addStatement(const Node &node) {
+    auto index = add(node);
+    if (_last != kNone)
+      _nodes[_last].rhs = index;
+    else
+      _first = index;
+    _last = index;
+  }
+
+ private:
+  std::pmr::vector<Node> _nodes;
+  // 还没有被使用的表达式结点
+  std::pmr::vector<uint32_t> _operands;
+  uint32_t _root;
+  // 语句的链表
+  uint32_t _first;
+  uint32_t _last;
+};
+}  // namespace miniplc0
@@ -0,0 +1,87 @@
+#include "ast/codegen.h"
+
+#include <utility>
+
+#include "stats/timer.h"
+
+namespace miniplc0 {
+namespace {
+// 按后缀的顺序生成表达式的指令
+// 栈中的 bool 表示这个结点的孩子是否已经展开过
+void generateExpression(const Ast &ast, std::uint32_t root,
+                        std::vector<Instruction> &out,
+                        std::vector<std::pair<std::uint32_t, bool>> &stack) {
+  stack.emplace_back(root, false);
+  while (!stack.empty()) {
+    auto [index, expanded] = stack.back();
+    stack.pop_back();
+    auto &node = ast.GetNode(index);
+    switch (node.kind) {
+      case Ast::Kind::Literal:
+        out.emplace_back(Operation::LIT, node.value);
+        break;
+      case Ast::Kind::Variable:
+        out.emplace_back(Operation::LOD, node.value);
+        break;
+      // 取负是 0 - x
+      case Ast::Kind::Negate:
+        if (expanded) {
+          out.emplace_back(Operation::SUB, 0);
+          break;
+        }
+        out.emplace_back(Operation::LIT, 0);
+        stack.emplace_back(index, true);
+        stack.emplace_back(node.lhs, false);
+        break;
+      case Ast::Kind::Binary:
+        if (expanded) {
+          out.emplace_back(node.op, 0);
+          break;
+        }
+        stack.emplace_back(index, true);
+        stack.emplace_back(node.rhs, false);
+        stack.emplace_back(node.lhs, false);
+        break;
+      default:
+        DieAndPrint("unexpected AST node in an expression.");
+    }
+  }
+}
+}  // namespace
+
+std::vector<Instruction> GenerateCode(const Ast &ast, SourceMap *source_map) {
+  MINIPLC0_TIME_SCOPE("code generation");
+  std::vector<Instruction> out;
+  if (source_map) source_map->Clear();
+  if (ast.GetRoot() == Ast::kNone) return out;
+  std::vector<std::pair<std::uint32_t, bool>> stack;
+  for (auto it = ast.GetNode(ast.GetRoot()).lhs; it != Ast::kNone;
+       it = ast.GetNode(it).rhs) {
+    auto &node = ast.GetNode(it);
+    if (source_map) source_map->Add(out.size(), node.offset);
+    switch (node.kind) {
+      case Ast::Kind::ConstDecl:
+        out.emplace_back(Operation::LIT, node.value);
+        break;
+      // 没有初始值时加载一个任意的值
+      case Ast::Kind::VarDecl:
+        if (node.lhs == Ast::kNone)
+          out.emplace_back(Operation::LIT, 0);
+        else
+          generateExpression(ast, node.lhs, out, stack);
+        break;
+      case Ast::Kind::Assign:
+        generateExpression(ast, node.lhs, out, stack);
+        out.emplace_back(Operation::STO, node.value);
+        break;
+      case Ast::Kind::Print:
+        generateExpression(ast, node.lhs, out, stack);
+        out.emplace_back(Operation::WRT, 0);
+        break;
+      default:
+        DieAndPrint("unexpected AST node in a statement.");
+    }
+  }
+  return out;
+}
+}  // namespace miniplc0
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <vector>
+
+#include "ast/ast.h"
+#include "instruction/instruction.h"
+#include "instruction/source_map.h"
+
+namespace miniplc0 {
+
+// 把语法树翻译成指令，和 Analyser 直接生成的指令完全相同
+// 表达式用显式的栈遍历，不受嵌套深度的限制
+// source_map 不为空时记录每个语句的指令来自哪里
+std::vector<Instruction> GenerateCode(const Ast &ast,
+                                      SourceMap *source_map = nullptr);
+}  // namespace miniplc0
@@ -0,0 +1,305 @@
+#include "ast/optimizer.h"
+
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "stats/timer.h"
+
+namespace miniplc0 {
+namespace {
+using int32_t = std::int32_t;
+using int64_t = std::int64_t;
+using uint32_t = std::uint32_t;
+
+// 对表达式中的每一个结点调用 f，顺序任意
+// 和 GenerateCode() 一样用显式的栈，不受嵌套深度的限制
+template <typename F>
+void visit(Ast &ast, uint32_t root, std::vector<uint32_t> &stack, F f) {
+  stack.emplace_back(root);
+  while (!stack.empty()) {
+    auto &node = ast.GetNode(stack.back());
+    stack.pop_back();
+    f(node);
+    if (node.kind == Ast::Kind::Negate || node.kind == Ast::Kind::Binary)
+      stack.emplace_back(node.lhs);
+    if (node.kind == Ast::Kind::Binary) stack.emplace_back(node.rhs);
+  }
+}
+
+// 和虚拟机相同的运算，运行时会出错时返回空
+std::optional<int32_t> apply(Operation op, int32_t lhs, int32_t rhs) {
+  int64_t r;
+  switch (op) {
+    case Operation::ADD:
+      r = static_cast<int64_t>(lhs) + rhs;
+      break;
+    case Operation::SUB:
+      r = static_cast<int64_t>(lhs) - rhs;
+      break;
+    case Operation::MUL:
+      r = static_cast<int64_t>(lhs) * rhs;
+      break;
+    // INT32_MIN / -1 的结果超出范围，在下面处理
+    case Operation::DIV:
+      if (rhs == 0) return {};
+      r = static_cast<int64_t>(lhs) / rhs;
+      break;
+    default:
+      DieAndPrint("unexpected operation in an expression.");
+  }
+  if (r < INT32_MIN || r > INT32_MAX) return {};
+  return static_cast<int32_t>(r);
+}
+
+// 表达式不含变量，并且求值不会出错时返回它的值
+std::optional<int32_t> evaluate(const Ast &ast, uint32_t root,
+                                std::vector<std::pair<uint32_t, bool>> &stack,
+                                std::vector<int32_t> &values) {
+  stack.clear();
+  values.clear();
+  stack.emplace_back(root, false);
+  while (!stack.empty()) {
+    auto [index, expanded] = stack.back();
+    stack.pop_back();
+    auto &node = ast.GetNode(index);
+    switch (node.kind) {
+      case Ast::Kind::Literal:
+        values.emplace_back(node.value);
+        break;
+      case Ast::Kind::Variable:
+        return {};
+      case Ast::Kind::Negate:
+        if (expanded) {
+          auto r = apply(Operation::SUB, 0, values.back());
+          if (!r.has_value()) return {};
+          values.back() = r.value();
+          break;
+        }
+        stack.emplace_back(index, true);
+        stack.emplace_back(node.lhs, false);
+        break;
+      case Ast::Kind::Binary: {
+        if (expanded) {
+          auto rhs = values.back();
+          values.pop_back();
+          auto r = apply(node.op, values.back(), rhs);
+          if (!r.has_value()) return {};
+          values.back() = r.value();
+          break;
+        }
+        stack.emplace_back(index, true);
+        stack.emplace_back(node.rhs, false);
+        stack.emplace_back(node.lhs, false);
+        break;
+      }
+      default:
+        DieAndPrint("unexpected AST node in an expression.");
+    }
+  }
+  return values.back();
+}
+
+// 把表达式中值已知的变量换成常数，同时折叠不会出错的常数运算
+// 结点原地改为 Literal，它原来的孩子不再被引用
+// 运行时会出错的运算保持原样，所以这个错误仍然会在运行时发生
+void fold(Ast &ast, uint32_t root,
+          const std::vector<std::optional<int32_t>> &known,
+          std::vector<std::pair<uint32_t, bool>> &stack) {
+  auto makeLiteral = [](Ast::Node &node, int32_t value) {
+    node = {Ast::Kind::Literal, ILL, value, node.offset, Ast::kNone,
+            Ast::kNone};
+  };
+  stack.emplace_back(root, false);
+  while (!stack.empty()) {
+    auto [index, expanded] = stack.back();
+    stack.pop_back();
+    auto &node = ast.GetNode(index);
+    switch (node.kind) {
+      case Ast::Kind::Literal:
+        break;
+      case Ast::Kind::Variable:
+        if (known[node.value].has_value())
+          makeLiteral(node, known[node.value].value());
+        break;
+      case Ast::Kind::Negate: {
+        if (!expanded) {
+          stack.emplace_back(index, true);
+          stack.emplace_back(node.lhs, false);
+          break;
+        }
+        auto &operand = ast.GetNode(node.lhs);
+        if (operand.kind != Ast::Kind::Literal) break;
+        auto r = apply(Operation::SUB, 0, operand.value);
+        if (r.has_value()) makeLiteral(node, r.value());
+        break;
+      }
+      case Ast::Kind::Binary: {
+        if (!expanded) {
+          stack.emplace_back(index, true);
+          stack.emplace_back(node.rhs, false);
+          stack.emplace_back(node.lhs, false);
+          break;
+        }
+        auto &lhs = ast.GetNode(node.lhs);
+        auto &rhs = ast.GetNode(node.rhs);
+        if (lhs.kind != Ast::Kind::Literal || rhs.kind != Ast::Kind::Literal)
+          break;
+        auto r = apply(node.op, lhs.value, rhs.value);
+        if (r.has_value()) makeLiteral(node, r.value());
+        break;
+      }
+      default:
+        DieAndPrint("unexpected AST node in an expression.");
+    }
+  }
+}
+
+// 分析语法树时用到的临时空间
+struct Workspace {
+  std::vector<uint32_t> nodes;
+  std::vector<std::pair<uint32_t, bool>> expanded;
+  std::vector<int32_t> values;
+};
+
+// 表达式求值一定不会出错，删掉它不会改变程序的行为
+// 只有单独的变量，以及不含变量的表达式能够确定
+bool isSafe(const Ast &ast, uint32_t root, Workspace &ws) {
+  if (ast.GetNode(root).kind == Ast::Kind::Variable) return true;
+  return evaluate(ast, root, ws.expanded, ws.values).has_value();
+}
+}  // namespace
+
+void EliminateDeadStores(Ast &ast) {
+  MINIPLC0_TIME_SCOPE("dead store elimination");
+  if (ast.GetRoot() == Ast::kNone) return;
+  Workspace ws;
+  // 语句，以及每个声明占用的栈上的偏移，偏移就是声明的顺序
+  std::vector<uint32_t> statements;
+  std::vector<int32_t> slots;
+  int32_t slot_count = 0;
+  for (auto it = ast.GetNode(ast.GetRoot()).lhs; it != Ast::kNone;
+       it = ast.GetNode(it).rhs) {
+    auto kind = ast.GetNode(it).kind;
+    auto declaration =
+        kind == Ast::Kind::ConstDecl || kind == Ast::Kind::VarDecl;
+    statements.emplace_back(it);
+    slots.emplace_back(declaration ? slot_count++ : -1);
+  }
+
+  // 逆序做活跃变量分析：live 表示之后还会读取这个变量的值
+  // 语句之间没有跳转，一遍就够了
+  std::vector<bool> live(slot_count, false);
+  std::vector<bool> removed(statements.size(), false);
+  auto use = [&](uint32_t root) {
+    visit(ast, root, ws.nodes, [&](const Ast::Node &it) {
+      if (it.kind == Ast::Kind::Variable) live[it.value] = true;
+    });
+  };
+  for (auto i = statements.size(); i-- > 0;) {
+    auto &node = ast.GetNode(statements[i]);
+    switch (node.kind) {
+      case Ast::Kind::Print:
+        use(node.lhs);
+        break;
+      case Ast::Kind::Assign:
+        if (!live[node.value] && isSafe(ast, node.lhs, ws)) {
+          removed[i] = true;
+          break;
+        }
+        live[node.value] = false;
+        use(node.lhs);
+        break;
+      // 初始值不会被读取时改为没有初始值
+      case Ast::Kind::VarDecl:
+        if (node.lhs == Ast::kNone) break;
+        if (!live[slots[i]] && isSafe(ast, node.lhs, ws)) {
+          node.lhs = Ast::kNone;
+          break;
+        }
+        live[slots[i]] = false;
+        use(node.lhs);
+        break;
+      default:
+        break;
+    }
+  }
+
+  // 剩下的语句中既不被读取也不被存储的变量和常量可以删掉
+  std::vector<bool> used(slot_count, false);
+  for (std::size_t i = 0; i < statements.size(); i++) {
+    if (removed[i]) continue;
+    auto &node = ast.GetNode(statements[i]);
+    if (node.kind == Ast::Kind::ConstDecl) continue;
+    if (node.kind == Ast::Kind::Assign) used[node.value] = true;
+    if (node.kind == Ast::Kind::VarDecl) {
+      if (node.lhs == Ast::kNone) continue;
+      used[slots[i]] = true;
+    }
+    visit(ast, node.lhs, ws.nodes, [&](const Ast::Node &it) {
+      if (it.kind == Ast::Kind::Variable) used[it.value] = true;
+    });
+  }
+  std::vector<int32_t> renumbered(slot_count, -1);
+  for (int32_t i = 0, next = 0; i < slot_count; i++)
+    if (used[i]) renumbered[i] = next++;
+
+  // 重新连接语句的链表，同时重新编号
+  auto *last = &ast.GetNode(ast.GetRoot()).lhs;
+  for (std::size_t i = 0; i < statements.size(); i++) {
+    if (removed[i] || (slots[i] >= 0 && !used[slots[i]])) continue;
+    *last = statements[i];
+    auto &node = ast.GetNode(statements[i]);
+    last = &node.rhs;
+    if (node.kind == Ast::Kind::Assign) node.value = renumbered[node.value];
+    if (node.lhs == Ast::kNone) continue;
+    visit(ast, node.lhs, ws.nodes, [&](Ast::Node &it) {
+      if (it.kind == Ast::Kind::Variable) it.value = renumbered[it.value];
+    });
+  }
+  *last = Ast::kNone;
+}
+
+void PropagateConstants(Ast &ast) {
+  MINIPLC0_TIME_SCOPE("constant propagation");
+  if (ast.GetRoot() == Ast::kNone) return;
+  std::vector<std::pair<uint32_t, bool>> stack;
+  // 每个变量和常量当前的值，按声明的顺序编号
+  std::vector<std::optional<int32_t>> known;
+  auto value = [&](uint32_t root) -> std::optional<int32_t> {
+    fold(ast, root, known, stack);
+    auto &node = ast.GetNode(root);
+    if (node.kind != Ast::Kind::Literal) return {};
+    return node.value;
+  };
+  for (auto it = ast.GetNode(ast.GetRoot()).lhs; it != Ast::kNone;
+       it = ast.GetNode(it).rhs) {
+    auto &node = ast.GetNode(it);
+    switch (node.kind) {
+      case Ast::Kind::ConstDecl:
+        known.emplace_back(node.value);
+        break;
+      case Ast::Kind::VarDecl:
+        if (node.lhs == Ast::kNone)
+          known.emplace_back();
+        else
+          known.emplace_back(value(node.lhs));
+        break;
+      case Ast::Kind::Assign:
+        known[node.value] = value(node.lhs);
+        break;
+      case Ast::Kind::Print:
+        fold(ast, node.lhs, known, stack);
+        break;
+      default:
+        DieAndPrint("unexpected AST node in a statement.");
+    }
+  }
+}
+
+void Optimize(Ast &ast) {
+  PropagateConstants(ast);
+  EliminateDeadStores(ast);
+}
+}  // namespace miniplc0
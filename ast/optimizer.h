@@ -0,0 +1,22 @@
+#pragma once
+
+#include "ast/ast.h"
+
+namespace miniplc0 {
+
+// 语法树上的优化，优化之后 GenerateCode() 生成的指令输出完全相同的结果
+// 运行时会出错的表达式（溢出、除以零）一定会被保留，出错的位置也不变
+// 被删掉的结点仍然留在语法树的数组里，只是不再被引用
+
+// 常量传播：按语句的顺序记录每个变量当前的值
+// 值已知的变量换成常数，并折叠不会在运行时出错的常数运算
+// 之后变量的存储可能不再被读取，可以由 EliminateDeadStores() 删除
+void PropagateConstants(Ast &ast);
+
+// 删除值不会再被读取的存储：赋值语句和变量的初始值
+// 之后删除既不被读取也不被存储的变量和常量，其余变量在栈上的偏移重新编号
+void EliminateDeadStores(Ast &ast);
+
+// 依次运行所有的优化
+void Optimize(Ast &ast);
+}  // namespace miniplc0
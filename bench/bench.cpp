@@ -0,0 +1,564 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "analyser/analyser.h"
+#include "argparse/argparse.hpp"
+#include "ast/codegen.h"
+#include "bench/cli.hpp"
+#include "bench/counters.hpp"
+#include "fmt/core.h"
+#include "fmt/format.h"
+#include "fmts.hpp"
+#include "generator/generator.h"
+#include "instruction/source_map.h"
+#include "memory/arena.h"
+#include "output/writer.hpp"
+#include "stats/memory.h"
+#include "tokenizer/tokenizer.h"
+#include "vm/profile.hpp"
+#include "vm/sink.hpp"
+#include "vm/vm.hpp"
+
+// 分别测量每个阶段以及整个编译过程，结果以 JSON 输出
+// 用于比较不同版本的性能
+// 输入由 ProgramGenerator 按种子生成，相同的参数总是测量相同的程序
+// 生成的程序运行时不会出错，所以虚拟机总是运行到最后
+
+namespace {
+// 一个阶段重复若干次的耗时，单位是秒，以及平均每次的硬件计数
+class Timing final {
+ private:
+  using Counters = miniplc0::Counters;
+
+ public:
+  // 每次先调用 prepare() 准备输入，它不计时，然后调用 run() 并计时
+  template <typename Prepare, typename Run>
+  static Timing Measure(Counters &counters, std::size_t repeat,
+                        Prepare prepare, Run run) {
+    Timing t;
+    t._events.fill(0);
+    for (std::size_t i = 0; i < repeat; i++) {
+      prepare();
+      counters.Start();
+      auto start = std::chrono::steady_clock::now();
+      run();
+      std::chrono::duration<double> d =
+          std::chrono::steady_clock::now() - start;
+      counters.Stop();
+      t._seconds.emplace_back(d.count());
+      for (std::size_t e = 0; e < Counters::EventCount; e++)
+        t._events[e] += counters.Get(Counters::Event(e)).value_or(0);
+    }
+    for (auto &it : t._events) it /= repeat;
+    std::sort(t._seconds.begin(), t._seconds.end());
+    return t;
+  }
+
+  double Min() const { return _seconds.front(); }
+  double Median() const { return _seconds[_seconds.size() / 2]; }
+  double Events(Counters::Event e) const { return _events[e]; }
+
+ private:
+  std::vector<double> _seconds;
+  std::array<double, Counters::EventCount> _events;
+};
+
+// 输出到空设备，只测量格式化和 write(2) 的开销
+int nullDevice() {
+#ifdef _WIN32
+  static auto f = std::fopen("NUL", "w");
+#else
+  static auto f = std::fopen("/dev/null", "w");
+#endif
+  if (!f) miniplc0::Die("Fail to open the null device.");
+  return fileno(f);
+}
+
+// 出错时停在第一个错误，返回空的 token 序列
+// token 中的字符串在 arena 中，arena 必须比 token 活得久
+std::vector<miniplc0::Token> tokenize(const std::string &text,
+                                      miniplc0::Arena &arena) {
+  std::stringstream ss(text);
+  miniplc0::Tokenizer tkz(ss, &arena);
+  return tkz.AllTokens().first;
+}
+
+// 和 miniplc0 一样遇到错误后继续分析，errors 不为空时加上错误的个数
+std::vector<miniplc0::Token> tokenizeWithRecovery(
+    const std::string &text, miniplc0::Arena &arena,
+    std::size_t *errors = nullptr) {
+  std::stringstream ss(text);
+  miniplc0::Tokenizer tkz(ss, &arena);
+  auto p = tkz.AllTokensWithRecovery();
+  if (errors) *errors += p.second.size();
+  return std::move(p.first);
+}
+
+// 出错时停在第一个错误，返回空的指令序列
+std::vector<miniplc0::Instruction> analyse(std::vector<miniplc0::Token> v) {
+  miniplc0::Analyser analyser(std::move(v));
+  return analyser.Analyse().first;
+}
+
+// 有错误时指令是空的
+std::vector<miniplc0::Instruction> analyseWithRecovery(
+    std::vector<miniplc0::Token> v, std::size_t *errors = nullptr) {
+  miniplc0::Analyser analyser(std::move(v));
+  auto p = analyser.AnalyseWithRecovery();
+  if (errors) *errors += p.second.size();
+  return std::move(p.first);
+}
+
+void format(const std::vector<miniplc0::Instruction> &v) {
+  miniplc0::OutputWriter output(nullDevice());
+  for (auto &it : v) output.WriteLine(it);
+  output.Flush();
+}
+
+// "name": {"min_seconds": ..., "median_seconds": ..., "<rate>": ...}
+// 速率是每秒处理的量，按中位数计算
+// 之后是可用的硬件计数，以及 IPC 和每个 token 的 miss 数
+void writePhase(fmt::memory_buffer &out, const miniplc0::Counters &counters,
+                const char *name, const Timing &t, double tokens,
+                std::initializer_list<std::pair<const char *, double>> rates,
+                bool last = false) {
+  using miniplc0::Counters;
+  auto it = std::back_inserter(out);
+  fmt::format_to(it,
+                 "        \"{}\": {{\"min_seconds\": {:.6f}, "
+                 "\"median_seconds\": {:.6f}",
+                 name, t.Min(), t.Median());
+  for (auto &rate : rates)
+    fmt::format_to(it, ", \"{}\": {:.1f}", rate.first,
+                   rate.second / t.Median());
+  for (std::size_t e = 0; e < Counters::EventCount; e++)
+    if (counters.Available(Counters::Event(e)))
+      fmt::format_to(it, ", \"{}\": {:.0f}", Counters::kNames[e],
+                     t.Events(Counters::Event(e)));
+  if (counters.Available(Counters::Cycles) &&
+      counters.Available(Counters::Instructions) &&
+      t.Events(Counters::Cycles) > 0)
+    fmt::format_to(
+        it, ", \"ipc\": {:.3f}",
+        t.Events(Counters::Instructions) / t.Events(Counters::Cycles));
+  for (auto e : {Counters::BranchMisses, Counters::L1DMisses,
+                 Counters::LLCMisses})
+    if (counters.Available(e) && tokens > 0)
+      fmt::format_to(it, ", \"{}_per_token\": {:.4f}", Counters::kNames[e],
+                     t.Events(e) / tokens);
+  fmt::format_to(it, "}}{}\n", last ? "" : ",");
+}
+
+// "name": {"peak_bytes": ..., "total_bytes": ..., "allocations": ...}
+void writeHeap(fmt::memory_buffer &out, const char *name,
+               const miniplc0::HeapUsage &usage, bool last = false) {
+  fmt::format_to(std::back_inserter(out),
+                 "        \"{}\": {{\"peak_bytes\": {}, \"total_bytes\": {}, "
+                 "\"allocations\": {}}}{}\n",
+                 name, usage.peak, usage.total, usage.allocations,
+                 last ? "" : ",");
+}
+
+void benchmark(miniplc0::Counters &counters,
+               const miniplc0::GeneratorOptions &options, std::size_t repeat,
+               fmt::memory_buffer &out, bool last) {
+  auto text = miniplc0::GenerateProgram(options);
+  // 之后的阶段的输入和 miniplc0 的相同，有错误时也是如此
+  // 第一次运行时统计每个阶段的堆内存和错误，不计时
+  miniplc0::Arena arena;
+  miniplc0::HeapPhase heap;
+  std::size_t errors = 0;
+  auto tokens = tokenizeWithRecovery(text, arena, &errors);
+  auto tokenize_heap = heap.Stop();
+  heap = miniplc0::HeapPhase();
+  auto instructions = analyseWithRecovery(tokens, &errors);
+  auto analyse_heap = heap.Stop();
+  heap = miniplc0::HeapPhase();
+  format(instructions);
+  auto format_heap = heap.Stop();
+  fmt::memory_buffer formatted;
+  for (auto &it : instructions)
+    fmt::format_to(std::back_inserter(formatted), "{}\n", it);
+  double mb = text.size() / 1e6;
+  double output_mb = formatted.size() / 1e6;
+  double token_count = tokens.size();
+  double instruction_count = instructions.size();
+
+  auto nothing = []() {};
+  auto tokenize_time = Timing::Measure(counters, repeat, nothing, [&]() {
+    miniplc0::Arena local;
+    tokenize(text, local);
+  });
+  auto tokenize_recovery_time =
+      Timing::Measure(counters, repeat, nothing, [&]() {
+        miniplc0::Arena local;
+        tokenizeWithRecovery(text, local);
+      });
+  // 分析和虚拟机的输入在计时之前复制
+  std::vector<miniplc0::Token> copy;
+  auto analyse_time = Timing::Measure(
+      counters, repeat, [&]() { copy = tokens; },
+      [&]() { analyse(std::move(copy)); });
+  auto analyse_recovery_time = Timing::Measure(
+      counters, repeat, [&]() { copy = tokens; },
+      [&]() { analyseWithRecovery(std::move(copy)); });
+  auto format_time = Timing::Measure(counters, repeat, nothing,
+                                     [&]() { format(instructions); });
+  // 虚拟机的输出和 miniplc0 一样逐行写出，只是写到空设备
+  std::unique_ptr<miniplc0::VM> vm;
+  auto vm_time = Timing::Measure(
+      counters, repeat,
+      [&]() { vm = std::make_unique<miniplc0::VM>(instructions); },
+      [&]() {
+        miniplc0::DecimalSink sink(nullDevice());
+        vm->Run(sink);
+      });
+  auto total_time = Timing::Measure(counters, repeat, nothing, [&]() {
+    miniplc0::Arena local;
+    auto v = analyseWithRecovery(tokenizeWithRecovery(text, local));
+    format(v);
+    miniplc0::DecimalSink sink(nullDevice());
+    miniplc0::VM(std::move(v)).Run(sink);
+  });
+
+  auto it = std::back_inserter(out);
+  fmt::format_to(it, "    {{\n");
+  fmt::format_to(it, "      \"statements\": {},\n", options.statements);
+  fmt::format_to(it, "      \"errors\": {},\n", errors);
+  fmt::format_to(it, "      \"input_bytes\": {},\n", text.size());
+  fmt::format_to(it, "      \"output_bytes\": {},\n", formatted.size());
+  fmt::format_to(it, "      \"tokens\": {},\n", tokens.size());
+  fmt::format_to(it, "      \"instructions\": {},\n", instructions.size());
+  if (miniplc0::kCountAllocations) {
+    fmt::format_to(it, "      \"memory\": {{\n");
+    writeHeap(out, "tokenize", tokenize_heap);
+    writeHeap(out, "analyse", analyse_heap);
+    writeHeap(out, "format", format_heap, true);
+    fmt::format_to(it, "      }},\n");
+  }
+  fmt::format_to(it, "      \"phases\": {{\n");
+  writePhase(out, counters, "tokenize", tokenize_time, token_count,
+             {{"mb_per_s", mb}, {"tokens_per_s", token_count}});
+  writePhase(out, counters, "tokenize_with_recovery", tokenize_recovery_time,
+             token_count, {{"mb_per_s", mb}, {"tokens_per_s", token_count}});
+  writePhase(out, counters, "analyse", analyse_time, token_count,
+             {{"tokens_per_s", token_count},
+              {"instructions_per_s", instruction_count}});
+  writePhase(out, counters, "analyse_with_recovery", analyse_recovery_time,
+             token_count,
+             {{"tokens_per_s", token_count},
+              {"instructions_per_s", instruction_count}});
+  writePhase(out, counters, "format", format_time, token_count,
+             {{"mb_per_s", output_mb},
+              {"instructions_per_s", instruction_count}});
+  writePhase(out, counters, "vm", vm_time, token_count,
+             {{"instructions_per_s", instruction_count}});
+  writePhase(out, counters, "end_to_end", total_time, token_count,
+             {{"mb_per_s", mb},
+              {"tokens_per_s", token_count},
+              {"instructions_per_s", instruction_count}},
+             true);
+  fmt::format_to(it, "      }}\n    }}{}\n", last ? "" : ",");
+}
+
+// 逗号分隔的正整数
+std::vector<std::size_t> parseSizes(const std::string &s) {
+  std::vector<std::size_t> sizes;
+  std::stringstream ss(s);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    try {
+      sizes.emplace_back(std::stoul(item));
+    } catch (const std::exception &) {
+      miniplc0::Die("--sizes expects comma separated positive integers.");
+    }
+  }
+  if (sizes.empty())
+    miniplc0::Die("--sizes expects comma separated positive integers.");
+  return sizes;
+}
+
+double percent(std::uint64_t part, std::uint64_t whole) {
+  return whole == 0 ? 0.0 : 100.0 * part / whole;
+}
+
+// 按时间排序的操作和最热的指令，以及按次数排序的相邻操作的组合
+void writeProfile(fmt::memory_buffer &out, const miniplc0::VMProfile &profile,
+                  const std::vector<miniplc0::Instruction> &instructions) {
+  auto it = std::back_inserter(out);
+  std::uint64_t ticks = 0, pairs = 0;
+  for (auto op : profile.OperationsByTicks())
+    ticks += profile.GetOperation(op).ticks;
+  for (auto &pair : profile.PairsByCount()) pairs += pair.count;
+  auto &names = miniplc0::fmts::kOperationNames;
+
+  fmt::format_to(it, "Operations by ticks:\n");
+  fmt::format_to(it, "  {:<6}{:>14}{:>16}{:>12}{:>9}\n", "op", "count",
+                 "ticks", "ticks/op", "%");
+  for (auto op : profile.OperationsByTicks()) {
+    auto &e = profile.GetOperation(op);
+    fmt::format_to(it, "  {:<6}{:>14}{:>16}{:>12.1f}{:>8.2f}%\n", names[op],
+                   e.count, e.ticks, double(e.ticks) / e.count,
+                   percent(e.ticks, ticks));
+  }
+  fmt::format_to(it, "\nHottest instructions:\n");
+  fmt::format_to(it, "  {:<10}{:<16}{:>14}{:>16}{:>9}\n", "index",
+                 "instruction", "count", "ticks", "%");
+  for (auto index : profile.HottestInstructions(20)) {
+    auto e = profile.GetInstruction(index);
+    fmt::format_to(it, "  {:<10}{:<16}{:>14}{:>16}{:>8.2f}%\n", index,
+                   fmt::format("{}", instructions[index]), e.count, e.ticks,
+                   percent(e.ticks, ticks));
+  }
+  fmt::format_to(it, "\nOperation pairs by count:\n");
+  fmt::format_to(it, "  {:<6}{:<6}{:>14}{:>9}\n", "first", "then", "count",
+                 "%");
+  for (auto &pair : profile.PairsByCount())
+    fmt::format_to(it, "  {:<6}{:<6}{:>14}{:>8.2f}%\n", names[pair.first],
+                   names[pair.second], pair.count, percent(pair.count, pairs));
+}
+
+// 去掉一行源代码两边的空白，';' 是 folded stack 中的分隔符，换成 ','
+std::string frameName(std::string_view line) {
+  auto first = line.find_first_not_of(" \t");
+  auto last = line.find_last_not_of(" \t;");
+  if (first == std::string_view::npos || last < first) return "";
+  std::string s(line.substr(first, last - first + 1));
+  std::replace(s.begin(), s.end(), ';', ',');
+  return s;
+}
+
+// 每一行源代码前面是这一行的语句执行的指令数和时间
+void writeListing(fmt::memory_buffer &out, const miniplc0::VMProfile &profile,
+                  const miniplc0::SourceMap &source_map,
+                  const miniplc0::Tokenizer &tkz) {
+  std::vector<miniplc0::VMProfile::Entry> lines;
+  std::uint64_t ticks = 0;
+  for (auto &source : profile.BySource(source_map)) {
+    auto line = tkz.GetPos(source.offset).first;
+    if (lines.size() <= line) lines.resize(line + 1);
+    lines[line].count += source.entry.count;
+    lines[line].ticks += source.entry.ticks;
+    ticks += source.entry.ticks;
+  }
+  auto it = std::back_inserter(out);
+  fmt::format_to(it, "{:>14}{:>16}{:>9}  {:>6}  source\n", "count", "ticks",
+                 "%", "line");
+  // 输入以换行结束时，最后一个换行之后的空行不输出
+  auto end = static_cast<std::uint32_t>(tkz.GetInputSize());
+  auto line_count = tkz.GetPos(end).first + 1;
+  if (line_count > 1 && tkz.GetLine(line_count - 1).empty()) line_count--;
+  for (std::uint64_t line = 0; line < line_count; line++) {
+    auto text = tkz.GetLine(line);
+    if (line < lines.size() && lines[line].count > 0)
+      fmt::format_to(it, "{:>14}{:>16}{:>8.2f}%  {:>6}  {}\n",
+                     lines[line].count, lines[line].ticks,
+                     percent(lines[line].ticks, ticks), line + 1, text);
+    else
+      fmt::format_to(it, "{:>39}  {:>6}  {}\n", "", line + 1, text);
+  }
+}
+
+// 每一行是 "miniplc0;<行号>: <源代码>;<操作> <时间>"，可以直接交给
+// flamegraph.pl 之类的工具
+void writeFolded(fmt::memory_buffer &out, const miniplc0::VMProfile &profile,
+                 const miniplc0::SourceMap &source_map,
+                 const std::vector<miniplc0::Instruction> &instructions,
+                 const miniplc0::Tokenizer &tkz) {
+  auto &runs = source_map.GetRuns();
+  auto &names = miniplc0::fmts::kOperationNames;
+  auto it = std::back_inserter(out);
+  for (std::size_t r = 0; r < runs.size(); r++) {
+    auto last = r + 1 < runs.size() ? runs[r + 1].instruction
+                                    : instructions.size();
+    auto line = tkz.GetPos(runs[r].offset).first;
+    auto frame = frameName(tkz.GetLine(line));
+    // 同一个语句中相同的操作合并成一个栈
+    std::array<std::uint64_t, miniplc0::VMProfile::kOperationCount> ticks{};
+    for (auto i = runs[r].instruction; i < last; i++)
+      ticks[instructions[i].GetOperation()] += profile.GetInstruction(i).ticks;
+    for (std::size_t op = 0; op < ticks.size(); op++)
+      if (ticks[op] > 0)
+        fmt::format_to(it, "miniplc0;{}: {};{} {}\n", line + 1, frame,
+                       names[op], ticks[op]);
+  }
+}
+
+void writeFile(const std::string &file, const fmt::memory_buffer &content) {
+  auto f = file == "-" ? stdout : std::fopen(file.c_str(), "w");
+  if (!f) miniplc0::Die(fmt::format("Fail to open {} for writing.", file));
+  std::fwrite(content.data(), 1, content.size(), f);
+  if (f != stdout) std::fclose(f);
+}
+
+// 从语法树生成指令，这样可以得到指令到源代码的映射
+// 运行一次虚拟机，把各种报告写到对应的文件，文件名为空时不写
+void profile(const std::string &text, const std::string &report_file,
+             const std::string &listing_file,
+             const std::string &folded_file) {
+  miniplc0::Arena arena;
+  std::stringstream ss(text);
+  miniplc0::Tokenizer tkz(ss, &arena);
+  auto tokens = tkz.AllTokens();
+  if (tokens.second.has_value())
+    miniplc0::Die("The profiled program is invalid.");
+  miniplc0::Analyser analyser(std::move(tokens.first), &arena);
+  auto ast = analyser.AnalyseToAst(1);
+  if (!ast.second.empty()) miniplc0::Die("The profiled program is invalid.");
+  miniplc0::SourceMap source_map;
+  auto instructions = miniplc0::GenerateCode(ast.first, &source_map);
+
+  miniplc0::VMProfile profile;
+  miniplc0::VM vm(instructions);
+  vm.SetProfile(&profile);
+  try {
+    vm.Run();
+  } catch (const std::exception &e) {
+    fmt::print(stderr, "The profiled program stopped: {}\n", e.what());
+  }
+  fmt::memory_buffer out;
+  if (!report_file.empty()) {
+    writeProfile(out, profile, instructions);
+    writeFile(report_file, out);
+  }
+  if (!listing_file.empty()) {
+    out.clear();
+    writeListing(out, profile, source_map, tkz);
+    writeFile(listing_file, out);
+  }
+  if (!folded_file.empty()) {
+    out.clear();
+    writeFolded(out, profile, source_map, instructions, tkz);
+    writeFile(folded_file, out);
+  }
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+  miniplc0::GeneratorOptions defaults;
+  argparse::ArgumentParser program("miniplc0_bench");
+  program.add_argument("--sizes")
+      .default_value(std::string("1000,10000,100000"))
+      .help("comma separated numbers of statements of the generated inputs.");
+  program.add_argument("--seed")
+      .default_value(std::to_string(defaults.seed))
+      .help("seed of the generated inputs, see miniplc0_gen.");
+  program.add_argument("--max-depth")
+      .default_value(std::to_string(defaults.max_depth))
+      .help("maximum nesting depth of brackets in an expression.");
+  program.add_argument("--lexical-errors")
+      .default_value(std::string("0"))
+      .help("probability that a statement has a lexical error.");
+  program.add_argument("--syntax-errors")
+      .default_value(std::string("0"))
+      .help("probability that a statement has a syntax error.");
+  program.add_argument("--semantic-errors")
+      .default_value(std::string("0"))
+      .help("probability that a statement uses an undeclared variable.");
+  program.add_argument("--repeat")
+      .default_value(std::string("5"))
+      .help("run each phase this many times and report the median.");
+  program.add_argument("-o", "--output")
+      .default_value(std::string("-"))
+      .help("write the JSON report to this file.");
+  program.add_argument("--profile-vm")
+      .default_value(std::string(""))
+      .help(
+          "profile the vm on the largest input and write the report to this "
+          "file, needs a build with MINIPLC0_PROFILE_VM.");
+  program.add_argument("--profile-listing")
+      .default_value(std::string(""))
+      .help("write the source annotated with the profile to this file.");
+  program.add_argument("--profile-folded")
+      .default_value(std::string(""))
+      .help("write the profile as folded stacks for flame graphs to this "
+            "file.");
+  program.add_argument("--profile-input")
+      .default_value(std::string(""))
+      .help("profile this program instead of the largest generated input.");
+
+  try {
+    program.parse_args(argc, argv);
+  } catch (const std::runtime_error &err) {
+    fmt::print(stderr, "{}\n\n", err.what());
+    std::cout << program;
+    exit(2);
+  }
+
+  auto sizes = parseSizes(program.get<std::string>("--sizes"));
+  std::size_t repeat = 0;
+  try {
+    repeat = std::stoul(program.get<std::string>("--repeat"));
+  } catch (const std::exception &) {
+  }
+  if (repeat == 0) miniplc0::Die("--repeat expects a positive integer.");
+  miniplc0::GeneratorOptions options;
+  options.runnable = true;
+  options.seed = miniplc0::GetInteger(program, "--seed");
+  options.max_depth = miniplc0::GetInteger(program, "--max-depth");
+  options.lexical_error_rate = miniplc0::GetRate(program, "--lexical-errors");
+  options.syntax_error_rate = miniplc0::GetRate(program, "--syntax-errors");
+  options.semantic_error_rate =
+      miniplc0::GetRate(program, "--semantic-errors");
+  auto profile_file = program.get<std::string>("--profile-vm");
+  auto listing_file = program.get<std::string>("--profile-listing");
+  auto folded_file = program.get<std::string>("--profile-folded");
+  auto profile_input = program.get<std::string>("--profile-input");
+  bool profiling = !profile_file.empty() || !listing_file.empty() ||
+                   !folded_file.empty();
+  if (profiling && !miniplc0::kProfileVM)
+    miniplc0::Die("Profiling the vm needs a build with MINIPLC0_PROFILE_VM.");
+
+  // 不可用的计数器不出现在结果中，"counters" 列出可用的计数器
+  miniplc0::Counters counters;
+  fmt::memory_buffer out;
+  auto it = std::back_inserter(out);
+  fmt::format_to(it, "{{\n  \"repeat\": {},\n  \"seed\": {},\n", repeat,
+                 options.seed);
+  fmt::format_to(it, "  \"counters\": [");
+  const char *separator = "";
+  for (std::size_t e = 0; e < miniplc0::Counters::EventCount; e++)
+    if (counters.Available(miniplc0::Counters::Event(e))) {
+      fmt::format_to(it, "{}\"{}\"", separator,
+                     miniplc0::Counters::kNames[e]);
+      separator = ", ";
+    }
+  fmt::format_to(it, "],\n  \"results\": [\n");
+  for (std::size_t i = 0; i < sizes.size(); i++) {
+    options.statements = sizes[i];
+    benchmark(counters, options, repeat, out, i + 1 == sizes.size());
+  }
+  fmt::format_to(std::back_inserter(out), "  ]\n}}\n");
+
+  writeFile(program.get<std::string>("--output"), out);
+
+  if (profiling) {
+    std::string text;
+    if (profile_input.empty()) {
+      options.statements = *std::max_element(sizes.begin(), sizes.end());
+      text = miniplc0::GenerateProgram(options);
+    } else {
+      std::ifstream input(profile_input);
+      if (!input)
+        miniplc0::Die(
+            fmt::format("Fail to open {} for reading.", profile_input));
+      text.assign(std::istreambuf_iterator<char>(input), {});
+    }
+    profile(text, profile_file, listing_file, folded_file);
+  }
+  return 0;
+}
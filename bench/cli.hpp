@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <string>
+
+#include "argparse/argparse.hpp"
+#include "fmt/core.h"
+
+// 性能测试的几个命令行程序共用的辅助函数
+// 参数都是字符串，在这里检查并转换，出错时输出信息并退出
+
+namespace miniplc0 {
+// 命令行参数有误，退出码和 argparse 解析失败时相同
+[[noreturn]] inline void Die(const std::string &message) {
+  fmt::print(stderr, "{}\n", message);
+  std::exit(2);
+}
+
+// 非负整数，不接受负号和多余的字符
+inline std::uint64_t GetInteger(argparse::ArgumentParser &program,
+                                const std::string &name) {
+  try {
+    std::size_t end;
+    auto s = program.get<std::string>(name);
+    auto v = std::stoull(s, &end);
+    if (end == s.size() && s[0] != '-') return v;
+  } catch (const std::exception &) {
+  }
+  Die(name + " expects a non-negative integer.");
+}
+
+// [0, 1] 中的概率
+inline double GetRate(argparse::ArgumentParser &program,
+                      const std::string &name) {
+  try {
+    std::size_t end;
+    auto s = program.get<std::string>(name);
+    auto v = std::stod(s, &end);
+    if (end == s.size() && v >= 0 && v <= 1) return v;
+  } catch (const std::exception &) {
+  }
+  Die(name + " expects a number between 0 and 1.");
+}
+}  // namespace miniplc0
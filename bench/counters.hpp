@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace miniplc0 {
+
+// 用 perf_event_open(2) 读取当前线程的硬件计数器，只统计用户态
+// 每个计数器单独打开，内核或者硬件不支持的计数器（比如在虚拟机中，
+// 或者 perf_event_paranoid 不允许时）只是不可用，其他的照常工作
+// 不是 Linux 时全部不可用
+class Counters final {
+ public:
+  enum Event {
+    Cycles,
+    Instructions,
+    BranchMisses,
+    L1DMisses,
+    LLCMisses,
+    EventCount
+  };
+
+  // 在 JSON 中使用的名字
+  static constexpr const char *kNames[EventCount] = {
+      "cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses"};
+
+ public:
+  Counters() : _fds(), _values() {
+    _fds.fill(-1);
+#ifdef __linux__
+    constexpr std::uint64_t l1d_read_miss =
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    _fds[Cycles] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    _fds[Instructions] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    _fds[BranchMisses] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    _fds[L1DMisses] = open(PERF_TYPE_HW_CACHE, l1d_read_miss);
+    _fds[LLCMisses] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+#endif
+  }
+  Counters(const Counters &) = delete;
+  Counters &operator=(const Counters &) = delete;
+  ~Counters() {
+#ifdef __linux__
+    for (auto fd : _fds)
+      if (fd >= 0) close(fd);
+#endif
+  }
+
+  bool Available(Event e) const { return _fds[e] >= 0; }
+  bool AnyAvailable() const {
+    for (auto fd : _fds)
+      if (fd >= 0) return true;
+    return false;
+  }
+
+  // 清零并开始计数
+  void Start() {
+#ifdef __linux__
+    for (auto fd : _fds)
+      if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+#endif
+  }
+  // 停止计数，读出从 Start() 开始的计数
+  void Stop() {
+#ifdef __linux__
+    for (std::size_t i = 0; i < EventCount; i++) {
+      if (_fds[i] < 0) continue;
+      ioctl(_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+      std::uint64_t value = 0;
+      if (read(_fds[i], &value, sizeof(value)) == sizeof(value))
+        _values[i] = value;
+      else
+        _values[i] = 0;
+    }
+#endif
+  }
+  // 最近一次 Start() 和 Stop() 之间的计数，不可用时为空
+  std::optional<std::uint64_t> Get(Event e) const {
+    if (!Available(e)) return {};
+    return _values[e];
+  }
+
+ private:
+#ifdef __linux__
+  static int open(std::uint32_t type, std::uint64_t config) {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+#endif
+
+ private:
+  std::array<int, EventCount> _fds;
+  std::array<std::uint64_t, EventCount> _values;
+};
+}  // namespace miniplc0
@@ -0,0 +1,99 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include "argparse/argparse.hpp"
+#include "bench/cli.hpp"
+#include "fmt/core.h"
+#include "generator/generator.h"
+
+// 按种子生成 miniplc0 程序，输出是流式的，可以生成任意大的输入
+
+int main(int argc, char **argv) {
+  miniplc0::GeneratorOptions defaults;
+  argparse::ArgumentParser program("miniplc0_gen");
+  program.add_argument("--seed")
+      .default_value(std::to_string(defaults.seed))
+      .help("the same seed and options always generate the same program.");
+  program.add_argument("--constants")
+      .default_value(std::to_string(defaults.constants))
+      .help("number of constants.");
+  program.add_argument("--variables")
+      .default_value(std::to_string(defaults.variables))
+      .help("number of variables.");
+  program.add_argument("--statements")
+      .default_value(std::to_string(defaults.statements))
+      .help("number of statements after the declarations.");
+  program.add_argument("--max-depth")
+      .default_value(std::to_string(defaults.max_depth))
+      .help("maximum nesting depth of brackets in an expression.");
+  program.add_argument("--max-width")
+      .default_value(std::to_string(defaults.max_width))
+      .help("maximum number of operands at each level of an expression.");
+  program.add_argument("--identifier-length")
+      .default_value(std::to_string(defaults.identifier_length))
+      .help("minimum length of identifiers.");
+  program.add_argument("--max-literal")
+      .default_value(std::to_string(defaults.max_literal))
+      .help("maximum value of integer literals.");
+  program.add_argument("--lexical-errors")
+      .default_value(std::string("0"))
+      .help("probability that a statement has a lexical error.");
+  program.add_argument("--syntax-errors")
+      .default_value(std::string("0"))
+      .help("probability that a statement has a syntax error.");
+  program.add_argument("--semantic-errors")
+      .default_value(std::string("0"))
+      .help("probability that a statement uses an undeclared variable.");
+  program.add_argument("--runnable")
+      .default_value(false)
+      .implicit_value(true)
+      .help("generate a program without overflows or divisions by zero.");
+  program.add_argument("-o", "--output")
+      .default_value(std::string("-"))
+      .help("specify the output file.");
+
+  try {
+    program.parse_args(argc, argv);
+  } catch (const std::runtime_error &err) {
+    fmt::print(stderr, "{}\n\n", err.what());
+    std::cout << program;
+    exit(2);
+  }
+
+  miniplc0::GeneratorOptions options;
+  options.seed = miniplc0::GetInteger(program, "--seed");
+  options.constants = miniplc0::GetInteger(program, "--constants");
+  options.variables = miniplc0::GetInteger(program, "--variables");
+  options.statements = miniplc0::GetInteger(program, "--statements");
+  options.max_depth = miniplc0::GetInteger(program, "--max-depth");
+  options.max_width = miniplc0::GetInteger(program, "--max-width");
+  options.identifier_length =
+      miniplc0::GetInteger(program, "--identifier-length");
+  auto max_literal = miniplc0::GetInteger(program, "--max-literal");
+  if (max_literal > INT32_MAX)
+    miniplc0::Die("--max-literal must fit in 32 bits.");
+  options.max_literal = static_cast<std::int32_t>(max_literal);
+  options.lexical_error_rate = miniplc0::GetRate(program, "--lexical-errors");
+  options.syntax_error_rate = miniplc0::GetRate(program, "--syntax-errors");
+  options.semantic_error_rate = miniplc0::GetRate(program, "--semantic-errors");
+  options.runnable = program.get<bool>("--runnable");
+
+  auto output_file = program.get<std::string>("--output");
+  auto f = output_file == "-" ? stdout : std::fopen(output_file.c_str(), "w");
+  if (!f)
+    miniplc0::Die(fmt::format("Fail to open {} for writing.", output_file));
+  bool good = true;
+  miniplc0::ProgramGenerator generator(options);
+  generator.Generate([&](std::string_view chunk) {
+    if (good && std::fwrite(chunk.data(), 1, chunk.size(), f) != chunk.size())
+      good = false;
+  });
+  if (std::fflush(f) != 0) good = false;
+  if (f != stdout) std::fclose(f);
+  if (!good) miniplc0::Die(fmt::format("Fail to write {}.", output_file));
+  return 0;
+}
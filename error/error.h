@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <utility>
 
 namespace miniplc0 {
@@ -40,23 +41,23 @@ enum ErrorCode {
   ErrInvalidPrint
 };
 
+// 位置是源代码中的字节偏移，需要行号和列号时通过 Tokenizer 的行表换算
 class CompilationError final {
  private:
   using uint64_t = std::uint64_t;
+  using uint32_t = std::uint32_t;
 
  public:
   friend void swap(CompilationError &lhs, CompilationError &rhs);
 
-  CompilationError(uint64_t line, uint64_t column, ErrorCode err)
-      : _pos(line, column), _err(err) {}
-  CompilationError(std::pair<uint64_t, uint64_t> pos, ErrorCode err)
-      : CompilationError(pos.first, pos.second, err) {}
+  CompilationError(uint32_t offset, ErrorCode err)
+      : _offset(offset), _err(err) {}
   CompilationError(const CompilationError &ce) {
-    _pos = ce._pos;
+    _offset = ce._offset;
     _err = ce._err;
   }
   CompilationError(CompilationError &&ce)
-      : CompilationError(0, 0, ErrorCode::ErrNoError) {
+      : CompilationError(0, ErrorCode::ErrNoError) {
     swap(*this, ce);
   }
   CompilationError &operator=(CompilationError ce) {
@@ -64,20 +65,42 @@ class CompilationError final {
     return *this;
   }
   bool operator==(const CompilationError &rhs) const {
-    return _pos == rhs._pos && _err == rhs._err;
+    return _offset == rhs._offset && _err == rhs._err;
   }
 
-  std::pair<uint64_t, uint64_t> GetPos() const { return _pos; }
+  uint32_t GetOffset() const { return _offset; }
   ErrorCode GetCode() const { return _err; }
 
  private:
-  std::pair<uint64_t, uint64_t> _pos;
+  uint32_t _offset;
   ErrorCode _err;
 };
 
 inline void swap(CompilationError &lhs, CompilationError &rhs) {
   using std::swap;
-  swap(lhs._pos, rhs._pos);
+  swap(lhs._offset, rhs._offset);
   swap(lhs._err, rhs._err);
 }
+
+// 错误加上出错的 <行号，列号> 和那一行源代码
+// 输出时会在出错的位置下面画一个 ^
+// 只在真正输出错误时才构造，所以不会影响没有错误时的性能
+class Diagnostic final {
+ private:
+  using uint64_t = std::uint64_t;
+
+ public:
+  Diagnostic(const CompilationError &err, std::pair<uint64_t, uint64_t> pos,
+             std::string_view line)
+      : _err(err), _pos(pos), _line(line) {}
+
+  const CompilationError &GetError() const { return _err; }
+  std::pair<uint64_t, uint64_t> GetPos() const { return _pos; }
+  std::string_view GetLine() const { return _line; }
+
+ private:
+  const CompilationError &_err;
+  std::pair<uint64_t, uint64_t> _pos;
+  std::string_view _line;
+};
 }  // namespace miniplc0
@@ -1,7 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <any>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+
 #include "analyser/analyser.h"
 #include "fmt/core.h"
+#include "fmt/format.h"
 #include "tokenizer/tokenizer.h"
 
+// 所有枚举的名字都放在按枚举值索引的静态表里
+// formatter 直接把名字拷贝到输出，不产生临时的 std::string
+// 注意：表的顺序必须和枚举的定义顺序一致
+namespace miniplc0::fmts {
+inline constexpr std::string_view kErrorCodeNames[] = {
+    "No error.",
+    "Stream error.",
+    "EOF",
+    "The input is invalid.",
+    "Identifier is invalid",
+    "The integer is too big(int64_t).",
+    "The program should start with 'begin'.",
+    "The program should end with 'end'.",
+    "Need an identifier here.",
+    "The constant need a value to initialize.",
+    "Zai? Wei shen me bu xie fen hao.",
+    "The declaration is invalid.",
+    "The expression is incomplete.",
+    "The variable or constant must be declared before being used.",
+    "Trying to assign value to a constant.",
+    "The variable or constant has been declared.",
+    "The variable has not been initialized.",
+    "The assignment statement is invalid.",
+    "The output statement is invalid.",
+};
+
+inline constexpr std::string_view kTokenTypeNames[] = {
+    "NullToken",
+    "UnsignedInteger",
+    "Identifier",
+    "Begin",
+    "End",
+    "Var",
+    "Const",
+    "Print",
+    "PlusSign",
+    "MinusSign",
+    "MultiplicationSign",
+    "DivisionSign",
+    "EqualSign",
+    "Semicolon",
+    "LeftBracket",
+    "RightBracket",
+};
+
+inline constexpr std::string_view kOperationNames[] = {
+    "ILL",
+    "LIT",
+    "LOD",
+    "STO",
+    "ADD",
+    "SUB",
+    "MUL",
+    "DIV",
+    "WRT",
+};
+
+static_assert(std::size(kErrorCodeNames) == ErrInvalidPrint + 1);
+static_assert(std::size(kTokenTypeNames) == RIGHT_BRACKET + 1);
+static_assert(std::size(kOperationNames) == WRT + 1);
+
+// 超出表范围的值什么都不输出
+template <typename OutputIt, std::size_t N, typename Enum>
+OutputIt appendName(OutputIt out, const std::string_view (&table)[N], Enum e) {
+  auto i = static_cast<std::size_t>(e);
+  if (i >= N) return out;
+  return std::copy(table[i].begin(), table[i].end(), out);
+}
+}  // namespace miniplc0::fmts
+
 namespace fmt {
 template <>
 struct formatter<miniplc0::ErrorCode> {
@@ -12,98 +92,72 @@ struct formatter<miniplc0::ErrorCode> {
 
   template <typename FormatContext>
   auto format(const miniplc0::ErrorCode &p, FormatContext &ctx) {
-    std::string name;
-    switch (p) {
-      case miniplc0::ErrNoError:
-        name = "No error.";
-        break;
-      case miniplc0::ErrStreamError:
-        name = "Stream error.";
-        break;
-      case miniplc0::ErrEOF:
-        name = "EOF";
-        break;
-      case miniplc0::ErrInvalidInput:
-        name = "The input is invalid.";
-        break;
-      case miniplc0::ErrInvalidIdentifier:
-        name = "Identifier is invalid";
-        break;
-      case miniplc0::ErrIntegerOverflow:
-        name = "The integer is too big(int64_t).";
-        break;
-      case miniplc0::ErrNoBegin:
-        name = "The program should start with 'begin'.";
-        break;
-      case miniplc0::ErrNoEnd:
-        name = "The program should end with 'end'.";
-        break;
-      case miniplc0::ErrNeedIdentifier:
-        name = "Need an identifier here.";
-        break;
-      case miniplc0::ErrConstantNeedValue:
-        name = "The constant need a value to initialize.";
-        break;
-      case miniplc0::ErrNoSemicolon:
-        name = "Zai? Wei shen me bu xie fen hao.";
-        break;
-      case miniplc0::ErrInvalidVariableDeclaration:
-        name = "The declaration is invalid.";
-        break;
-      case miniplc0::ErrIncompleteExpression:
-        name = "The expression is incomplete.";
-        break;
-      case miniplc0::ErrNotDeclared:
-        name = "The variable or constant must be declared before being used.";
-        break;
-      case miniplc0::ErrAssignToConstant:
-        name = "Trying to assign value to a constant.";
-        break;
-      case miniplc0::ErrDuplicateDeclaration:
-        name = "The variable or constant has been declared.";
-        break;
-      case miniplc0::ErrNotInitialized:
-        name = "The variable has not been initialized.";
-        break;
-      case miniplc0::ErrInvalidAssignment:
-        name = "The assignment statement is invalid.";
-        break;
-      case miniplc0::ErrInvalidPrint:
-        name = "The output statement is invalid.";
-        break;
-    }
-    return format_to(ctx.out(), name);
+    return miniplc0::fmts::appendName(ctx.out(),
+                                      miniplc0::fmts::kErrorCodeNames, p);
   }
 };
 
 template <>
-struct formatter<miniplc0::CompilationError> {
+struct formatter<miniplc0::Located<miniplc0::CompilationError>> {
   template <typename ParseContext>
   constexpr auto parse(ParseContext &ctx) {
     return ctx.begin();
   }
 
   template <typename FormatContext>
-  auto format(const miniplc0::CompilationError &p, FormatContext &ctx) {
+  auto format(const miniplc0::Located<miniplc0::CompilationError> &p,
+              FormatContext &ctx) {
     return format_to(ctx.out(), "Line: {} Column: {} Error: {}",
-                     p.GetPos().first, p.GetPos().second, p.GetCode());
+                     p.GetPos().first, p.GetPos().second, p.Get().GetCode());
+  }
+};
+
+// 第一行和 Located<CompilationError> 的格式完全一样，后面跟着源代码和 ^
+// 为了对齐，^ 之前的 \t 原样保留
+template <>
+struct formatter<miniplc0::Diagnostic> {
+  template <typename ParseContext>
+  constexpr auto parse(ParseContext &ctx) {
+    return ctx.begin();
+  }
+
+  template <typename FormatContext>
+  auto format(const miniplc0::Diagnostic &p, FormatContext &ctx) {
+    using Located = miniplc0::Located<miniplc0::CompilationError>;
+    auto out = format_to(ctx.out(), "{}", Located(p.GetError(), p.GetPos()));
+    auto line = p.GetLine();
+    if (line.empty()) return out;
+    *out++ = '\n';
+    out = std::copy(line.begin(), line.end(), out);
+    *out++ = '\n';
+    auto column = std::min<std::size_t>(p.GetPos().second, line.size());
+    for (std::size_t i = 0; i < column; i++)
+      *out++ = line[i] == '\t' ? '\t' : ' ';
+    *out++ = '^';
+    return out;
   }
 };
 }  // namespace fmt
 
 namespace fmt {
 template <>
-struct formatter<miniplc0::Token> {
+struct formatter<miniplc0::Located<miniplc0::Token>> {
   template <typename ParseContext>
   constexpr auto parse(ParseContext &ctx) {
     return ctx.begin();
   }
 
   template <typename FormatContext>
-  auto format(const miniplc0::Token &p, FormatContext &ctx) {
-    return format_to(ctx.out(), "Line: {} Column: {} Type: {} Value: {}",
-                     p.GetStartPos().first, p.GetStartPos().second, p.GetType(),
-                     p.GetValueString());
+  auto format(const miniplc0::Located<miniplc0::Token> &p,
+              FormatContext &ctx) {
+    auto out = format_to(ctx.out(), "Line: {} Column: {} Type: {} Value: ",
+                         p.GetPos().first, p.GetPos().second,
+                         p.Get().GetType());
+    // 直接写到输出中，不构造临时的 std::string
+    auto value = p.Get().GetValue();
+    if (auto i = std::any_cast<std::int32_t>(&value))
+      return format_to(out, "{}", *i);
+    return format_to(out, "{}", p.Get().GetValueView());
   }
 };
 
@@ -116,58 +170,8 @@ struct formatter<miniplc0::TokenType> {
 
   template <typename FormatContext>
   auto format(const miniplc0::TokenType &p, FormatContext &ctx) {
-    std::string name;
-    switch (p) {
-      case miniplc0::NULL_TOKEN:
-        name = "NullToken";
-        break;
-      case miniplc0::UNSIGNED_INTEGER:
-        name = "UnsignedInteger";
-        break;
-      case miniplc0::IDENTIFIER:
-        name = "Identifier";
-        break;
-      case miniplc0::BEGIN:
-        name = "Begin";
-        break;
-      case miniplc0::END:
-        name = "End";
-        break;
-      case miniplc0::VAR:
-        name = "Var";
-        break;
-      case miniplc0::CONST:
-        name = "Const";
-        break;
-      case miniplc0::PRINT:
-        name = "Print";
-        break;
-      case miniplc0::PLUS_SIGN:
-        name = "PlusSign";
-        break;
-      case miniplc0::MINUS_SIGN:
-        name = "MinusSign";
-        break;
-      case miniplc0::MULTIPLICATION_SIGN:
-        name = "MultiplicationSign";
-        break;
-      case miniplc0::DIVISION_SIGN:
-        name = "DivisionSign";
-        break;
-      case miniplc0::EQUAL_SIGN:
-        name = "EqualSign";
-        break;
-      case miniplc0::SEMICOLON:
-        name = "Semicolon";
-        break;
-      case miniplc0::LEFT_BRACKET:
-        name = "LeftBracket";
-        break;
-      case miniplc0::RIGHT_BRACKET:
-        name = "RightBracket";
-        break;
-    }
-    return format_to(ctx.out(), name);
+    return miniplc0::fmts::appendName(ctx.out(),
+                                      miniplc0::fmts::kTokenTypeNames, p);
   }
 };
 }  // namespace fmt
@@ -182,37 +186,8 @@ struct formatter<miniplc0::Operation> {
 
   template <typename FormatContext>
   auto format(const miniplc0::Operation &p, FormatContext &ctx) {
-    std::string name;
-    switch (p) {
-      case miniplc0::ILL:
-        name = "ILL";
-        break;
-      case miniplc0::ADD:
-        name = "ADD";
-        break;
-      case miniplc0::SUB:
-        name = "SUB";
-        break;
-      case miniplc0::MUL:
-        name = "MUL";
-        break;
-      case miniplc0::DIV:
-        name = "DIV";
-        break;
-      case miniplc0::WRT:
-        name = "WRT";
-        break;
-      case miniplc0::LIT:
-        name = "LIT";
-        break;
-      case miniplc0::LOD:
-        name = "LOD";
-        break;
-      case miniplc0::STO:
-        name = "STO";
-        break;
-    }
-    return format_to(ctx.out(), name);
+    return miniplc0::fmts::appendName(ctx.out(),
+                                      miniplc0::fmts::kOperationNames, p);
   }
 };
 template <>
@@ -224,21 +199,19 @@ struct formatter<miniplc0::Instruction> {
 
   template <typename FormatContext>
   auto format(const miniplc0::Instruction &p, FormatContext &ctx) {
-    std::string name;
+    auto out = miniplc0::fmts::appendName(
+        ctx.out(), miniplc0::fmts::kOperationNames, p.GetOperation());
     switch (p.GetOperation()) {
-      case miniplc0::ILL:
-      case miniplc0::ADD:
-      case miniplc0::SUB:
-      case miniplc0::MUL:
-      case miniplc0::DIV:
-      case miniplc0::WRT:
-        return format_to(ctx.out(), "{}", p.GetOperation());
       case miniplc0::LIT:
       case miniplc0::LOD:
-      case miniplc0::STO:
-        return format_to(ctx.out(), "{} {}", p.GetOperation(), p.GetX());
+      case miniplc0::STO: {
+        *out++ = ' ';
+        format_int x(p.GetX());
+        return std::copy(x.data(), x.data() + x.size(), out);
+      }
+      default:
+        return out;
     }
-    return format_to(ctx.out(), "ILL");
   }
 };
 }  // namespace fmt
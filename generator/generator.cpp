@@ -0,0 +1,263 @@
+#include "generator/generator.h"
+
+#include <climits>
+#include <cstdlib>
+
+namespace miniplc0 {
+namespace {
+constexpr const char *kOperators[] = {" + ", " - ", " * ", " / "};
+}  // namespace
+
+ProgramGenerator::ProgramGenerator(const GeneratorOptions &options)
+    : _options(options),
+      _rng(options.seed),
+      _sink(nullptr),
+      _buffer(),
+      _error_count(0),
+      _readable(),
+      _initialized(),
+      _values(),
+      _remaining(),
+      _levels(),
+      _factor(),
+      _capture(nullptr) {
+  _buffer.reserve(kChunkSize);
+  if (_options.max_width == 0) _options.max_width = 1;
+  if (_options.max_literal < 0) _options.max_literal = 0;
+}
+
+void ProgramGenerator::Generate(const Sink &sink) {
+  _sink = &sink;
+  _rng.seed(_options.seed);
+  _error_count = 0;
+  _readable.clear();
+  _initialized.assign(_options.variables, false);
+  _values.assign(_options.constants + _options.variables, 0);
+
+  write("begin\n");
+  for (std::size_t i = 0; i < _options.constants; i++) constantDeclaration(i);
+  for (std::size_t i = 0; i < _options.variables; i++) variableDeclaration(i);
+  for (uint64_t i = 0; i < _options.statements; i++) statement();
+  write("end\n");
+  flush();
+  _sink = nullptr;
+}
+
+// <常量声明语句> ::= 'const'<标识符>'='<常表达式>{','...}';'
+// 这里每个语句只声明一个常量
+void ProgramGenerator::constantDeclaration(std::size_t index) {
+  write("  const ");
+  identifier('c', index);
+  write(" = ");
+  bool negative = random(2);
+  if (negative) write("-");
+  auto value = literal();
+  write(";\n");
+  _values[index] = negative ? -value : value;
+  _readable.emplace_back(index);
+}
+
+// <变量声明语句> ::= 'var'<标识符>['='<表达式>]';'
+void ProgramGenerator::variableDeclaration(std::size_t index) {
+  write("  var ");
+  identifier('v', index);
+  if (random(2)) {
+    write(" = ");
+    _values[_options.constants + index] = expression();
+    _initialized[index] = true;
+  }
+  write(";\n");
+  if (_initialized[index]) _readable.emplace_back(_options.constants + index);
+}
+
+// <语句> ::= <赋值语句>|<输出语句>|<空语句>
+void ProgramGenerator::statement() {
+  write("  ");
+  // 注入错误
+  if (chance(_options.lexical_error_rate)) {
+    _error_count++;
+    write("print(@);\n");
+    return;
+  }
+  if (chance(_options.syntax_error_rate)) {
+    _error_count++;
+    write("print((");
+    expression();
+    write(");\n");
+    return;
+  }
+  if (chance(_options.semantic_error_rate)) {
+    _error_count++;
+    identifier('u', random(_options.variables + 1));
+    write(" = ");
+    expression();
+    write(";\n");
+    return;
+  }
+
+  auto kind = random(20);
+  if (_options.variables > 0 && kind < 12) {
+    auto index = random(_options.variables);
+    identifier('v', index);
+    write(" = ");
+    _values[_options.constants + index] = expression();
+    write(";\n");
+    if (!_initialized[index]) {
+      _initialized[index] = true;
+      _readable.emplace_back(_options.constants + index);
+    }
+  } else if (kind < 19) {
+    write("print(");
+    expression();
+    write(");\n");
+  } else {
+    write(";\n");
+  }
+}
+
+// <表达式> ::= <项>{<加法型运算符><项>}
+// 这里不区分 <项> 和 <因子>，每一层括号是若干个因子用运算符连起来
+// 用显式的栈记录每一层剩下的项数，深度不受限制
+std::int32_t ProgramGenerator::expression() {
+  if (_options.runnable) return runnableExpression();
+  _remaining.clear();
+  _remaining.emplace_back(1 + random(_options.max_width));
+  while (true) {
+    // 一个因子，它可能是一层新的括号
+    if (random(4) == 0) write(random(2) ? "-" : "+");
+    if (_remaining.size() <= _options.max_depth && random(3) == 0) {
+      write("(");
+      _remaining.emplace_back(1 + random(_options.max_width));
+      continue;
+    }
+    factor();
+    // 这一层结束时关闭括号，回到外层
+    while (--_remaining.back() == 0) {
+      _remaining.pop_back();
+      if (_remaining.empty()) return 0;
+      write(")");
+    }
+    write(kOperators[random(4)]);
+  }
+}
+
+// 形式和 expression() 相同，但是每个因子先写进它所在的那一层的缓冲区
+// 知道了因子的值之后再选择它前面的运算符，整个表达式结束后才写到输出
+// 所有的值都不是 INT32_MIN，所以取负和除以 -1 也不会溢出
+std::int32_t ProgramGenerator::runnableExpression() {
+  _levels.clear();
+  _levels.push_back({0, 1 + random(_options.max_width), "", 0, 0});
+  while (true) {
+    int sign = random(4) == 0 ? (random(2) ? -1 : 1) : 0;
+    if (_levels.size() <= _options.max_depth && random(3) == 0) {
+      _levels.push_back({sign, 1 + random(_options.max_width), "", 0, 0});
+      continue;
+    }
+    _factor = sign < 0 ? "-" : sign > 0 ? "+" : "";
+    _capture = &_factor;
+    std::int64_t value = factor();
+    _capture = nullptr;
+    append(_levels.back(), _factor, sign < 0 ? -value : value);
+    // 这一层结束时关闭括号，作为一个因子接到外层
+    while (--_levels.back().remaining == 0) {
+      auto level = std::move(_levels.back());
+      _levels.pop_back();
+      value = level.sum + level.term;
+      if (_levels.empty()) {
+        write(level.text);
+        return static_cast<std::int32_t>(value);
+      }
+      _factor = level.sign < 0 ? "-(" : level.sign > 0 ? "+(" : "(";
+      _factor += level.text;
+      _factor += ")";
+      append(_levels.back(), _factor, level.sign < 0 ? -value : value);
+    }
+  }
+}
+
+// 虚拟机先算出一项再把它加到和上，所以只要 sum、term 和 sum + term
+// 都在范围内就不会溢出
+// 随机选择的运算符会出错时改用加号或者减号，让新的项和 sum + term 异号
+// 这时新的和的绝对值不超过两者中较大的一个，所以总在范围内
+void ProgramGenerator::append(Level &level, std::string_view text,
+                              std::int64_t value) {
+  if (level.text.empty()) {
+    level.text = text;
+    level.term = value;
+    return;
+  }
+  auto fits = [](std::int64_t v) { return std::llabs(v) <= INT32_MAX; };
+  auto sum = level.sum, term = level.term;
+  auto op = random(4);
+  if (op == 0 || op == 1) {
+    sum += term;
+    term = op == 0 ? value : -value;
+  } else if (op == 2) {
+    term *= value;
+  } else if (value != 0) {
+    term /= value;
+  }
+  if ((op == 3 && value == 0) || !fits(term) || !fits(sum + term)) {
+    sum = level.sum + level.term;
+    op = (sum > 0) == (value > 0) ? 1 : 0;
+    term = op == 0 ? value : -value;
+  }
+  level.text += kOperators[op];
+  level.text += text;
+  level.sum = sum;
+  level.term = term;
+}
+
+// 标识符或者常数
+std::int32_t ProgramGenerator::factor() {
+  if (_readable.empty() || random(2)) return literal();
+  auto index = _readable[random(_readable.size())];
+  if (index < _options.constants)
+    identifier('c', index);
+  else
+    identifier('v', index - _options.constants);
+  return _values[index];
+}
+
+void ProgramGenerator::identifier(char prefix, std::size_t index) {
+  auto digits = std::to_string(index);
+  write(std::string_view(&prefix, 1));
+  for (auto n = digits.size() + 1; n < _options.identifier_length; n++)
+    write("0");
+  write(digits);
+}
+
+std::int32_t ProgramGenerator::literal() {
+  auto value = random(_options.max_literal + uint64_t(1));
+  write(std::to_string(value));
+  return static_cast<std::int32_t>(value);
+}
+
+void ProgramGenerator::write(std::string_view s) {
+  if (_capture) {
+    _capture->append(s);
+    return;
+  }
+  // runnable 时整个表达式一次写入，可能比一块还大
+  while (_buffer.size() + s.size() > kChunkSize) {
+    auto n = kChunkSize - _buffer.size();
+    _buffer.append(s.substr(0, n));
+    s.remove_prefix(n);
+    flush();
+  }
+  _buffer.append(s);
+}
+
+void ProgramGenerator::flush() {
+  if (!_buffer.empty()) (*_sink)(_buffer);
+  _buffer.clear();
+}
+
+std::string GenerateProgram(const GeneratorOptions &options) {
+  std::string s;
+  ProgramGenerator(options).Generate([&](std::string_view chunk) {
+    s.append(chunk);
+  });
+  return s;
+}
+}  // namespace miniplc0
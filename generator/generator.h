@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace miniplc0 {
+
+// 生成程序的参数
+struct GeneratorOptions {
+  // 相同的参数和种子总是生成相同的程序
+  std::uint64_t seed = 0;
+  // 常量和变量的个数
+  std::size_t constants = 4;
+  std::size_t variables = 8;
+  // <语句序列> 中语句的个数
+  std::uint64_t statements = 100;
+  // 表达式中括号嵌套的最大深度，以及每一层最多的项数
+  std::size_t max_depth = 3;
+  std::size_t max_width = 4;
+  // 标识符的最短长度，不够时在编号前面补 0
+  std::size_t identifier_length = 1;
+  // 常数的最大值
+  std::int32_t max_literal = 100;
+  // 每个语句是某一类错误的概率，分别对应词法错误、语法错误和语义错误
+  double lexical_error_rate = 0;
+  double syntax_error_rate = 0;
+  double semantic_error_rate = 0;
+  // 生成运行时不会出错的程序：生成时计算每个表达式的值
+  // 只选择不会溢出、也不会除以 0 的运算符
+  bool runnable = false;
+};
+
+// 随机生成 miniplc0 程序，用于测试和大规模的性能测试
+// 没有注入错误时生成的程序一定能通过编译，除非 runnable，运行时可能溢出
+// 输出是流式的：内容先写进一块固定大小的缓冲区，满了之后交给 sink
+// 所以内存的使用和程序的长度无关，只和变量的个数以及表达式的深度有关
+class ProgramGenerator final {
+ private:
+  using uint64_t = std::uint64_t;
+
+ public:
+  // 每次交给 sink 的内容不超过这么大
+  static constexpr std::size_t kChunkSize = 1 << 16;
+
+  using Sink = std::function<void(std::string_view)>;
+
+ public:
+  explicit ProgramGenerator(const GeneratorOptions &options);
+
+  // 生成整个程序，sink 依次收到程序的每一块
+  void Generate(const Sink &sink);
+  // 最近一次生成的程序中注入的错误个数，每个语句最多一个
+  uint64_t GetErrorCount() const { return _error_count; }
+
+ private:
+  void constantDeclaration(std::size_t index);
+  void variableDeclaration(std::size_t index);
+  void statement();
+  // 只读取常量和已经初始化的变量
+  // 返回表达式的值，只有 runnable 时才计算，否则返回 0
+  std::int32_t expression();
+  std::int32_t runnableExpression();
+  std::int32_t factor();
+  // 常量是 c0, c1, ...，变量是 v0, v1, ...，未声明的名字是 u0, u1, ...
+  void identifier(char prefix, std::size_t index);
+  std::int32_t literal();
+
+  // [0, n) 中的一个数
+  uint64_t random(uint64_t n) { return _rng() % n; }
+  // 概率为 p 的事件
+  bool chance(double p) { return p > 0 && _rng() < p * 0x1p64; }
+  void write(std::string_view s);
+  void flush();
+
+  // runnable 时的一层括号，值都在 [-INT32_MAX, INT32_MAX] 中
+  struct Level {
+    // 括号前面的正负号，-1、0 或者 1
+    int sign;
+    // 这一层还剩下的项数
+    std::size_t remaining;
+    // 这一层已经生成的内容
+    std::string text;
+    // 已经结束的项的和，以及当前的项，包括它前面的加减号
+    std::int64_t sum;
+    std::int64_t term;
+  };
+  // 把值为 value 的因子接到 level 后面，选择一个不会出错的运算符
+  void append(Level &level, std::string_view text, std::int64_t value);
+
+ private:
+  GeneratorOptions _options;
+  std::mt19937_64 _rng;
+  const Sink *_sink;
+  std::string _buffer;
+  uint64_t _error_count;
+  // 可以读取的名字：常量的下标是 [0, constants)，变量的下标加上 constants
+  std::vector<std::size_t> _readable;
+  std::vector<bool> _initialized;
+  // runnable 时常量和变量的值，下标和 _readable 中的相同
+  std::vector<std::int32_t> _values;
+  // 生成表达式时每一层括号还剩下的项数
+  std::vector<std::size_t> _remaining;
+  // runnable 时每一层括号，以及正在生成的因子
+  std::vector<Level> _levels;
+  std::string _factor;
+  // 不为空时 write() 写到这里，而不是输出
+  std::string *_capture;
+};
+
+// 生成整个程序并放在一个字符串中，用于测试
+std::string GenerateProgram(const GeneratorOptions &options);
+}  // namespace miniplc0
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace miniplc0 {
+
+// 指令下标到源代码偏移的映射，用于把运行时的统计归到源代码
+// 一个语句生成的指令是连续的一段，所以只记录每一段的第一条指令
+// 和这个语句的第一个 token 的偏移，查找时二分
+class SourceMap final {
+ private:
+  using uint32_t = std::uint32_t;
+
+ public:
+  // 从 instruction 开始的一段指令
+  struct Run {
+    std::size_t instruction;
+    uint32_t offset;
+  };
+
+ public:
+  SourceMap() : _runs({}) {}
+
+  // 从 instruction 开始的指令来自 offset，instruction 必须是不减的
+  // 上一段是空的时候覆盖它，偏移和上一段相同时合并
+  void Add(std::size_t instruction, uint32_t offset) {
+    if (!_runs.empty() && _runs.back().instruction == instruction)
+      _runs.pop_back();
+    if (!_runs.empty() && _runs.back().offset == offset) return;
+    _runs.push_back({instruction, offset});
+  }
+  void Clear() { _runs.clear(); }
+
+  // 第 instruction 条指令来自的偏移，在第一段之前时为空
+  std::optional<uint32_t> Find(std::size_t instruction) const {
+    auto it = std::upper_bound(
+        _runs.begin(), _runs.end(), instruction,
+        [](std::size_t i, const Run &run) { return i < run.instruction; });
+    if (it == _runs.begin()) return {};
+    return std::prev(it)->offset;
+  }
+  const std::vector<Run> &GetRuns() const { return _runs; }
+
+ private:
+  std::vector<Run> _runs;
+};
+}  // namespace miniplc0
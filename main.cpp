@@ -1,40 +1,183 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "analyser/analyser.h"
 #include "argparse/argparse.hpp"
+#include "ast/codegen.h"
+#include "ast/optimizer.h"
 #include "fmt/core.h"
 #include "fmts.hpp"
+#include "memory/arena.h"
+#include "output/writer.hpp"
+#include "stats/memory.h"
+#include "stats/timer.h"
 #include "tokenizer/tokenizer.h"
+#include "vm/frame.h"
 
-std::vector<miniplc0::Token> _tokenize(std::istream &input) {
-  miniplc0::Tokenizer tkz(input);
-  auto p = tkz.AllTokens();
-  if (p.second.has_value()) {
-    fmt::print(stderr, "Tokenization error: {}\n", p.second.value());
-    // 由于平台限制，必须返回 0
-    exit(0);
+// --time-passes 和 --stats 的结果
+// 出错时会直接 exit(0)，所以在 std::atexit() 中输出
+struct _Report {
+  bool time_passes = false;
+  bool stats = false;
+  miniplc0::PassTimes times;
+  std::uint64_t bytes_read = 0;
+  std::uint64_t tokens = 0;
+  std::uint64_t symbols = 0;
+  std::uint64_t instructions = 0;
+  // 运行生成的指令需要的栈，见 vm/frame.h
+  std::uint64_t stack_slots = 0;
+  std::uint64_t bytes_written = 0;
+  // 每个阶段从 arena 分配的内存，以及堆内存使用，见 stats/memory.h
+  struct Phase {
+    const char *name;
+    std::uint64_t arena_bytes;
+    std::uint64_t arena_allocations;
+    miniplc0::HeapUsage heap;
+  };
+  std::vector<Phase> phases;
+} _report;
+
+void _printReport() {
+  if (_report.time_passes) {
+    if (!miniplc0::kTimePasses)
+      fmt::print(stderr, "Time: built without MINIPLC0_TIME_PASSES.\n");
+    double wall = 0, cpu = 0;
+    for (auto &it : _report.times.GetPasses()) {
+      fmt::print(stderr, "Time: {}: {:.6f} s wall, {:.6f} s cpu.\n", it.name,
+                 it.wall, it.cpu);
+      wall += it.wall;
+      cpu += it.cpu;
+    }
+    fmt::print(stderr, "Time: total: {:.6f} s wall, {:.6f} s cpu.\n", wall,
+               cpu);
+  }
+  if (_report.stats) {
+    fmt::print(stderr, "Stats: {} bytes read.\n", _report.bytes_read);
+    fmt::print(stderr, "Stats: {} tokens.\n", _report.tokens);
+    fmt::print(stderr, "Stats: {} symbols.\n", _report.symbols);
+    fmt::print(stderr, "Stats: {} instructions.\n", _report.instructions);
+    fmt::print(stderr, "Stats: {} stack slots.\n", _report.stack_slots);
+    fmt::print(stderr, "Stats: {} bytes written.\n", _report.bytes_written);
+    for (auto &it : _report.phases)
+      fmt::print(stderr, "Stats: {}: arena {} bytes in {} allocations.\n",
+                 it.name, it.arena_bytes, it.arena_allocations);
+    if (!miniplc0::kCountAllocations)
+      fmt::print(stderr, "Stats: built without MINIPLC0_COUNT_ALLOCATIONS.\n");
+    std::uint64_t peak = 0;
+    for (auto &it : _report.phases) {
+      fmt::print(stderr,
+                 "Stats: {}: peak heap {} bytes, {} bytes in {} allocations.\n",
+                 it.name, it.heap.peak, it.heap.total, it.heap.allocations);
+      peak = std::max(peak, it.heap.peak);
+    }
+    fmt::print(stderr, "Stats: peak heap {} bytes.\n", peak);
+  }
+}
+
+// 记录刚结束的阶段的内存使用，然后开始统计下一个阶段
+// 所有阶段共用一个 arena，减去前面的阶段就是这个阶段分配的
+void _recordPhase(const char *phase, const miniplc0::Arena &arena,
+                  miniplc0::HeapPhase &heap) {
+  auto bytes = arena.GetBytes();
+  auto allocations = arena.GetAllocations();
+  for (auto &it : _report.phases) {
+    bytes -= it.arena_bytes;
+    allocations -= it.arena_allocations;
   }
+  _report.phases.push_back({phase, bytes, allocations, heap.Stop()});
+  heap = miniplc0::HeapPhase();
+}
+
+// 词法错误不会立即退出，而是交给调用者决定
+std::vector<miniplc0::Token> _tokenize(miniplc0::Tokenizer &tkz,
+                                       std::size_t max_errors,
+                                       std::size_t jobs,
+                                       std::size_t &error_count) {
+  MINIPLC0_TIME_SCOPE("tokenization");
+  // 并行分析只能找到第一个错误，有错误时再串行分析一遍
+  if (jobs > 1) {
+    auto p = tkz.AllTokensParallel(jobs);
+    if (!p.second.has_value()) {
+      error_count = 0;
+      return p.first;
+    }
+  }
+  auto p = tkz.AllTokensWithRecovery(max_errors);
+  for (auto &err : p.second)
+    fmt::print(stderr, "Tokenization error: {}\n", tkz.GetDiagnostic(err));
+  error_count = p.second.size();
   return p.first;
 }
 
-void Tokenize(std::istream &input, std::ostream &output) {
-  auto v = _tokenize(input);
-  for (auto &it : v) output << fmt::format("{}\n", it);
+void Tokenize(std::istream &input, miniplc0::OutputWriter &output,
+              std::size_t max_errors, std::size_t jobs) {
+  // 这次编译的所有 token 和符号表都从这里分配，结束时一起释放
+  miniplc0::Arena arena;
+  miniplc0::HeapPhase heap;
+  miniplc0::Tokenizer tkz(input, &arena);
+  std::size_t error_count;
+  auto v = _tokenize(tkz, max_errors, jobs, error_count);
+  _recordPhase("tokenization", arena, heap);
+  _report.bytes_read = tkz.GetInputSize();
+  _report.tokens = v.size();
+  // 由于平台限制，必须返回 0
+  if (error_count > 0) exit(0);
+  MINIPLC0_TIME_SCOPE("format");
+  for (auto &it : v) output.WriteLine(tkz.Locate(it));
+  _recordPhase("format", arena, heap);
   return;
 }
 
-void Analyse(std::istream &input, std::ostream &output) {
-  auto tks = _tokenize(input);
-  miniplc0::Analyser analyser(tks);
-  auto p = analyser.Analyse();
-  if (p.second.has_value()) {
-    fmt::print(stderr, "Syntactic analysis error: {}\n", p.second.value());
-    // 同上
-    exit(0);
+void Analyse(std::istream &input, miniplc0::OutputWriter &output,
+             std::size_t max_errors, std::size_t jobs, bool optimize) {
+  // 同上
+  miniplc0::Arena arena;
+  miniplc0::HeapPhase heap;
+  miniplc0::Tokenizer tkz(input, &arena);
+  std::size_t error_count;
+  auto tks = _tokenize(tkz, max_errors, jobs, error_count);
+  _recordPhase("tokenization", arena, heap);
+  _report.bytes_read = tkz.GetInputSize();
+  _report.tokens = tks.size();
+  // 有词法错误时仍然做语法分析，把剩下的错误也找出来
+  if (error_count >= max_errors) exit(0);
+  miniplc0::Analyser analyser(std::move(tks), &arena);
+  // 优化时先构造语法树，优化之后再从语法树生成指令
+  std::vector<miniplc0::Instruction> v;
+  std::vector<miniplc0::CompilationError> errors;
+  if (optimize) {
+    auto p = analyser.AnalyseToAst(max_errors - error_count);
+    miniplc0::Optimize(p.first);
+    v = miniplc0::GenerateCode(p.first);
+    errors = std::move(p.second);
+  } else {
+    auto p = analyser.AnalyseWithRecovery(max_errors - error_count);
+    v = std::move(p.first);
+    errors = std::move(p.second);
+  }
+  _recordPhase("syntactic analysis", arena, heap);
+  _report.symbols = analyser.GetSymbolCount();
+  _report.instructions = v.size();
+  if (_report.stats) {
+    auto frame = miniplc0::AnalyseFrame(v);
+    if (frame.first.has_value()) _report.stack_slots = frame.first->Slots();
   }
-  auto v = p.first;
-  for (auto &it : v) output << fmt::format("{}\n", it);
+  for (auto &err : errors)
+    fmt::print(stderr, "Syntactic analysis error: {}\n",
+               tkz.GetDiagnostic(err));
+  // 同上
+  if (error_count > 0 || !errors.empty()) exit(0);
+  MINIPLC0_TIME_SCOPE("format");
+  for (auto &it : v) output.WriteLine(it);
+  _recordPhase("format", arena, heap);
   return;
 }
 
@@ -49,6 +192,24 @@ int main(int argc, char **argv) {
       .required()
       .default_value(std::string("-"))
       .help("specify the output file.");
+  program.add_argument("--max-errors")
+      .default_value(std::string("1"))
+      .help("stop after reporting this many errors, 1 by default.");
+  program.add_argument("-j", "--jobs")
+      .default_value(std::string("1"))
+      .help("use this many threads for tokenization.");
+  program.add_argument("-O", "--optimize")
+      .default_value(false)
+      .implicit_value(true)
+      .help("propagate constants and remove dead stores.");
+  program.add_argument("--time-passes")
+      .default_value(false)
+      .implicit_value(true)
+      .help("report the wall and cpu time of each phase to stderr.");
+  program.add_argument("--stats")
+      .default_value(false)
+      .implicit_value(true)
+      .help("report the sizes and memory use of each phase to stderr.");
 
   try {
     program.parse_args(argc, argv);
@@ -58,12 +219,36 @@ int main(int argc, char **argv) {
     exit(2);
   }
 
+  _report.time_passes = program["--time-passes"] == true;
+  _report.stats = program["--stats"] == true;
+  if (_report.time_passes) _report.times.Install();
+  if (_report.time_passes || _report.stats) std::atexit(_printReport);
+
   auto input_file = program.get<std::string>("input");
   auto output_file = program.get<std::string>("--output");
+  std::size_t max_errors;
+  try {
+    max_errors = std::stoul(program.get<std::string>("--max-errors"));
+  } catch (const std::exception &) {
+    max_errors = 0;
+  }
+  if (max_errors == 0) {
+    fmt::print(stderr, "--max-errors expects a positive integer.\n");
+    exit(2);
+  }
+  std::size_t jobs;
+  try {
+    jobs = std::stoul(program.get<std::string>("--jobs"));
+  } catch (const std::exception &) {
+    jobs = 0;
+  }
+  if (jobs == 0) {
+    fmt::print(stderr, "--jobs expects a positive integer.\n");
+    exit(2);
+  }
   std::istream *input;
-  std::ostream *output;
   std::ifstream inf;
-  std::ofstream outf;
+  std::FILE *outf = nullptr;
   if (input_file != "-") {
     inf.open(input_file, std::ios::in);
     if (!inf) {
@@ -74,14 +259,14 @@ int main(int argc, char **argv) {
   } else
     input = &std::cin;
   if (output_file != "-") {
-    outf.open(output_file, std::ios::out | std::ios::trunc);
+    outf = std::fopen(output_file.c_str(), "wb");
     if (!outf) {
       fmt::print(stderr, "Fail to open {} for writing.\n", output_file);
       exit(2);
     }
-    output = &outf;
-  } else
-    output = &std::cout;
+  }
+  // 输出不经过 iostream，直接按块写到文件描述符
+  miniplc0::OutputWriter output(outf ? fileno(outf) : fileno(stdout));
   if (program["-t"] == true && program["-l"] == true) {
     fmt::print(
         stderr,
@@ -89,12 +274,21 @@ int main(int argc, char **argv) {
     exit(2);
   }
   if (program["-t"] == true) {
-    Tokenize(*input, *output);
+    Tokenize(*input, output, max_errors, jobs);
   } else if (program["-l"] == true) {
-    Analyse(*input, *output);
+    Analyse(*input, output, max_errors, jobs, program["--optimize"] == true);
   } else {
     fmt::print(stderr, "You must choose tokenization or syntactic analysis.");
     exit(2);
   }
+  {
+    MINIPLC0_TIME_SCOPE("write");
+    if (!output.Flush()) {
+      fmt::print(stderr, "Fail to write {}.\n", output_file);
+      exit(2);
+    }
+  }
+  _report.bytes_written = output.GetBytesWritten();
+  if (outf) std::fclose(outf);
   return 0;
 }
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <string_view>
+
+namespace miniplc0 {
+
+// 一次编译使用的 arena：只管分配，不单独释放，编译结束时一起释放
+// 它本身就是一个 std::pmr::memory_resource，pmr 容器可以直接从它分配
+// 例如 std::pmr::map<std::pmr::string, int>(&arena)
+// 同时统计分配的字节数和次数，用于报告每个阶段的内存使用
+// 不是线程安全的，每个线程应该使用自己的 arena，最后用 Adopt() 合并
+class Arena final : public std::pmr::memory_resource {
+ private:
+  using uint64_t = std::uint64_t;
+
+  // 每一块内存的开头，块之间用链表连起来
+  struct Chunk {
+    Chunk *next;
+    std::size_t size;
+  };
+
+ public:
+  // 每次向上游申请的内存块的大小，更大的分配单独占一块
+  static constexpr std::size_t kChunkSize = 64 << 10;
+
+ public:
+  explicit Arena(
+      std::pmr::memory_resource *upstream = std::pmr::new_delete_resource())
+      : _upstream(upstream),
+        _chunks(nullptr),
+        _ptr(nullptr),
+        _limit(nullptr),
+        _bytes(0),
+        _allocations(0),
+        _reserved(0) {}
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  ~Arena() { Release(); }
+
+  // 释放全部内存，之前分配的指针全部失效，统计数据清零
+  void Release() {
+    while (_chunks != nullptr) {
+      auto next = _chunks->next;
+      _upstream->deallocate(_chunks, _chunks->size, alignof(Chunk));
+      _chunks = next;
+    }
+    _ptr = _limit = nullptr;
+    _bytes = _allocations = _reserved = 0;
+  }
+  // 接管 other 的全部内存，other 中分配的指针在这里仍然有效
+  // other 变为空的，两者的上游必须相同
+  void Adopt(Arena &other) {
+    if (other._chunks == nullptr) return;
+    auto last = other._chunks;
+    while (last->next != nullptr) last = last->next;
+    // 接在当前块的后面，当前块剩下的空间仍然可用
+    if (_chunks != nullptr) {
+      last->next = _chunks->next;
+      _chunks->next = other._chunks;
+    } else {
+      _chunks = other._chunks;
+      _ptr = other._ptr;
+      _limit = other._limit;
+    }
+    _bytes += other._bytes;
+    _allocations += other._allocations;
+    _reserved += other._reserved;
+    other._chunks = nullptr;
+    other.Release();
+  }
+
+  // 复制一个字符串，末尾加上 \0，返回的指针在 arena 释放前有效
+  const char *CopyString(std::string_view s) {
+    auto p = static_cast<char *>(allocate(s.size() + 1, 1));
+    std::memcpy(p, s.data(), s.size());
+    p[s.size()] = '\0';
+    return p;
+  }
+
+  // 分配出去的字节数和次数
+  uint64_t GetBytes() const { return _bytes; }
+  uint64_t GetAllocations() const { return _allocations; }
+  // 从上游申请的字节数
+  uint64_t GetReserved() const { return _reserved; }
+
+ private:
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+    _bytes += bytes;
+    _allocations++;
+    auto p = align(_ptr, alignment);
+    if (_ptr == nullptr || p > _limit ||
+        static_cast<std::size_t>(_limit - p) < bytes) {
+      // 大的分配单独占一块，不浪费当前块剩下的空间
+      auto size = sizeof(Chunk) + alignment + bytes;
+      if (size > kChunkSize / 4) return align(newChunk(size, false), alignment);
+      _ptr = newChunk(kChunkSize, true);
+      _limit = _ptr + kChunkSize - sizeof(Chunk);
+      p = align(_ptr, alignment);
+    }
+    _ptr = p + bytes;
+    return p;
+  }
+  // 单独的释放什么都不做
+  void do_deallocate(void *, std::size_t, std::size_t) override {}
+  bool do_is_equal(
+      const std::pmr::memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+
+  // 申请一块内存，返回块头之后的第一个字节
+  // 新的当前块放在链表的开头，单独的大块放在第二个，链表只用于释放
+  char *newChunk(std::size_t size, bool current) {
+    auto chunk =
+        static_cast<Chunk *>(_upstream->allocate(size, alignof(Chunk)));
+    chunk->size = size;
+    _reserved += size;
+    if (current || _chunks == nullptr) {
+      chunk->next = _chunks;
+      _chunks = chunk;
+    } else {
+      chunk->next = _chunks->next;
+      _chunks->next = chunk;
+    }
+    return reinterpret_cast<char *>(chunk + 1);
+  }
+  static char *align(char *p, std::size_t alignment) {
+    auto v = reinterpret_cast<std::uintptr_t>(p);
+    return reinterpret_cast<char *>((v + alignment - 1) & ~(alignment - 1));
+  }
+
+ private:
+  std::pmr::memory_resource *_upstream;
+  Chunk *_chunks;
+  // 当前块中剩下的空间
+  char *_ptr;
+  char *_limit;
+  uint64_t _bytes;
+  uint64_t _allocations;
+  uint64_t _reserved;
+};
+}  // namespace miniplc0
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+#include "fmt/format.h"
+
+#ifdef _MSC_VER
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace miniplc0 {
+
+// 一个带缓冲区的输出端
+// 所有内容直接被 format 进一块可复用的缓冲区，不会产生临时的 std::string
+// 缓冲区满了之后才会一次性 write(2) 到文件描述符
+//
+// 注意：这个类不拥有文件描述符，也不会关闭它
+class OutputWriter final {
+ public:
+  static constexpr std::size_t kDefaultCapacity = 1 << 16;
+
+ public:
+  explicit OutputWriter(int fd, std::size_t capacity = kDefaultCapacity)
+      : _fd(fd), _capacity(capacity), _good(true), _written(0), _buffer() {
+    _buffer.reserve(_capacity);
+  }
+  OutputWriter(OutputWriter &&) = delete;
+  OutputWriter(const OutputWriter &) = delete;
+  OutputWriter &operator=(const OutputWriter &) = delete;
+  ~OutputWriter() { Flush(); }
+
+  // 相当于 output << fmt::format("{}\n", v)
+  template <typename T>
+  void WriteLine(const T &v) {
+    fmt::format_to(std::back_inserter(_buffer), "{}\n", v);
+    if (_buffer.size() >= _capacity) Flush();
+  }
+
+  // 把缓冲区的内容全部写出，失败时返回 false
+  bool Flush() {
+    const char *p = _buffer.data();
+    std::size_t left = _buffer.size();
+    while (_good && left > 0) {
+      auto n = writeSome(p, left);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        _good = false;
+        break;
+      }
+      p += n;
+      left -= static_cast<std::size_t>(n);
+      _written += static_cast<std::size_t>(n);
+    }
+    _buffer.clear();
+    return _good;
+  }
+
+  // 是否发生过写错误
+  bool Good() const { return _good; }
+  // 已经写出的字节数，不包括缓冲区中的
+  std::uint64_t GetBytesWritten() const { return _written; }
+
+ private:
+  long writeSome(const char *p, std::size_t n) {
+#ifdef _MSC_VER
+    return _write(_fd, p, static_cast<unsigned int>(n));
+#else
+    return ::write(_fd, p, n);
+#endif
+  }
+
+ private:
+  int _fd;
+  std::size_t _capacity;
+  bool _good;
+  std::uint64_t _written;
+  fmt::memory_buffer _buffer;
+};
+}  // namespace miniplc0
@@ -0,0 +1,138 @@
+#include "stats/memory.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace miniplc0 {
+namespace {
+std::atomic<std::uint64_t> current(0);
+std::atomic<std::uint64_t> peak(0);
+std::atomic<std::uint64_t> total(0);
+std::atomic<std::uint64_t> allocations(0);
+}  // namespace
+
+HeapUsage GetHeapUsage() {
+  HeapUsage usage;
+  usage.current = current.load(std::memory_order_relaxed);
+  usage.peak = peak.load(std::memory_order_relaxed);
+  usage.total = total.load(std::memory_order_relaxed);
+  usage.allocations = allocations.load(std::memory_order_relaxed);
+  return usage;
+}
+
+void ResetHeapPeak() {
+  peak.store(current.load(std::memory_order_relaxed),
+             std::memory_order_relaxed);
+}
+}  // namespace miniplc0
+
+// 替换的 operator new 和上面的函数在同一个文件中
+// 所以从静态库链接时，只要程序调用了 GetHeapUsage() 就会一起链接进去
+#ifdef MINIPLC0_COUNT_ALLOCATIONS
+namespace {
+using miniplc0::allocations;
+using miniplc0::current;
+using miniplc0::peak;
+using miniplc0::total;
+
+// 每次分配前面放一个块头，记录大小和 malloc() 返回的地址
+// 这样不带大小的 operator delete 也知道释放了多少
+struct Header {
+  std::size_t size;
+  void *base;
+};
+
+void *allocate(std::size_t size, std::size_t alignment) {
+  if (alignment < alignof(Header)) alignment = alignof(Header);
+  auto base = std::malloc(sizeof(Header) + alignment + size);
+  if (base == nullptr) return nullptr;
+  auto v = reinterpret_cast<std::uintptr_t>(base) + sizeof(Header);
+  auto p = reinterpret_cast<Header *>((v + alignment - 1) & ~(alignment - 1));
+  p[-1].size = size;
+  p[-1].base = base;
+
+  auto now = current.fetch_add(size, std::memory_order_relaxed) + size;
+  auto high = peak.load(std::memory_order_relaxed);
+  while (now > high &&
+         !peak.compare_exchange_weak(high, now, std::memory_order_relaxed)) {
+  }
+  total.fetch_add(size, std::memory_order_relaxed);
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  return p;
+}
+
+void *allocateOrThrow(std::size_t size, std::size_t alignment) {
+  // 和标准库一样，失败时调用 new_handler，没有 new_handler 时抛出异常
+  while (true) {
+    auto p = allocate(size, alignment);
+    if (p != nullptr) return p;
+    auto handler = std::get_new_handler();
+    if (handler == nullptr) throw std::bad_alloc();
+    handler();
+  }
+}
+
+void deallocate(void *p) {
+  if (p == nullptr) return;
+  auto header = static_cast<Header *>(p) - 1;
+  current.fetch_sub(header->size, std::memory_order_relaxed);
+  std::free(header->base);
+}
+
+constexpr auto kDefault = alignof(std::max_align_t);
+}  // namespace
+
+void *operator new(std::size_t size) { return allocateOrThrow(size, kDefault); }
+void *operator new[](std::size_t size) {
+  return allocateOrThrow(size, kDefault);
+}
+void *operator new(std::size_t size, std::align_val_t alignment) {
+  return allocateOrThrow(size, static_cast<std::size_t>(alignment));
+}
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+  return allocateOrThrow(size, static_cast<std::size_t>(alignment));
+}
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return allocate(size, kDefault);
+}
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return allocate(size, kDefault);
+}
+void *operator new(std::size_t size, std::align_val_t alignment,
+                   const std::nothrow_t &) noexcept {
+  return allocate(size, static_cast<std::size_t>(alignment));
+}
+void *operator new[](std::size_t size, std::align_val_t alignment,
+                     const std::nothrow_t &) noexcept {
+  return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void *p) noexcept { deallocate(p); }
+void operator delete[](void *p) noexcept { deallocate(p); }
+void operator delete(void *p, std::size_t) noexcept { deallocate(p); }
+void operator delete[](void *p, std::size_t) noexcept { deallocate(p); }
+void operator delete(void *p, std::align_val_t) noexcept { deallocate(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { deallocate(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+  deallocate(p);
+}
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept {
+  deallocate(p);
+}
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+  deallocate(p);
+}
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+  deallocate(p);
+}
+void operator delete(void *p, std::align_val_t,
+                     const std::nothrow_t &) noexcept {
+  deallocate(p);
+}
+void operator delete[](void *p, std::align_val_t,
+                       const std::nothrow_t &) noexcept {
+  deallocate(p);
+}
+#endif
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+
+namespace miniplc0 {
+
+// 统计整个进程的堆内存，用于 --stats 和 miniplc0_bench
+//
+// 构建时定义了 MINIPLC0_COUNT_ALLOCATIONS 时 stats/memory.cpp 替换全局的
+// operator new 和 operator delete，记录每次分配和释放
+// 所以 vector、string 以及 arena 向上游申请的内存都会被统计到
+// 没有定义时不替换，下面的函数总是返回 0
+#ifdef MINIPLC0_COUNT_ALLOCATIONS
+inline constexpr bool kCountAllocations = true;
+#else
+inline constexpr bool kCountAllocations = false;
+#endif
+
+struct HeapUsage {
+  // 正在使用的字节数，以及它的最大值
+  std::uint64_t current = 0;
+  std::uint64_t peak = 0;
+  // 累计分配的字节数和次数，释放时不减少
+  std::uint64_t total = 0;
+  std::uint64_t allocations = 0;
+};
+
+HeapUsage GetHeapUsage();
+// 把最大值重新设为当前值，之后的最大值只统计从现在开始的部分
+void ResetHeapPeak();
+
+// 一个阶段的堆内存使用：从构造到 Stop() 之间的峰值，以及分配的字节数和次数
+// 峰值是全局的，所以这样的阶段不能嵌套，也不能在多个线程上同时统计
+class HeapPhase final {
+ public:
+  HeapPhase() {
+    ResetHeapPeak();
+    _start = GetHeapUsage();
+  }
+
+  HeapUsage Stop() const {
+    auto usage = GetHeapUsage();
+    usage.total -= _start.total;
+    usage.allocations -= _start.allocations;
+    return usage;
+  }
+
+ private:
+  HeapUsage _start;
+};
+}  // namespace miniplc0
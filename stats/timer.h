@@ -0,0 +1,126 @@
+#pragma once
+
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+namespace miniplc0 {
+
+// 统计每个阶段用的时间，用于 --time-passes
+//
+// 需要计时的代码块开头写 MINIPLC0_TIME_SCOPE("name");
+// 构建时没有定义 MINIPLC0_TIME_PASSES 时这个宏什么都不生成
+// 运行时只有在当前线程上 Install() 了一个 PassTimes 才会记录
+// 其他线程上的计时器什么都不做，所以可以放在并行的代码里
+//
+// 嵌套的计时器不重复计算：外层的时间不包括内层的时间
+// 同名的计时器的时间累加在一起
+#ifdef MINIPLC0_TIME_PASSES
+inline constexpr bool kTimePasses = true;
+#define MINIPLC0_TIME_CONCAT_(a, b) a##b
+#define MINIPLC0_TIME_CONCAT(a, b) MINIPLC0_TIME_CONCAT_(a, b)
+#define MINIPLC0_TIME_SCOPE(name) \
+  ::miniplc0::ScopedTimer MINIPLC0_TIME_CONCAT(_scoped_timer_, __LINE__)(name)
+#else
+inline constexpr bool kTimePasses = false;
+#define MINIPLC0_TIME_SCOPE(name) static_cast<void>(0)
+#endif
+
+class ScopedTimer;
+
+// 一次编译中所有阶段的时间
+class PassTimes final {
+ public:
+  struct Pass {
+    const char *name;
+    // 墙上时间和 CPU 时间，单位是秒，CPU 时间包括所有线程
+    double wall;
+    double cpu;
+  };
+
+ public:
+  PassTimes() = default;
+  PassTimes(const PassTimes &) = delete;
+  PassTimes &operator=(const PassTimes &) = delete;
+  ~PassTimes() { Uninstall(); }
+
+  // 之后当前线程上的计时器记录到这里
+  void Install() { current() = this; }
+  void Uninstall() {
+    if (current() == this) current() = nullptr;
+  }
+  // 按第一次出现的顺序
+  const std::vector<Pass> &GetPasses() const { return _passes; }
+
+ private:
+  friend class ScopedTimer;
+
+  static PassTimes *&current() {
+    thread_local PassTimes *times = nullptr;
+    return times;
+  }
+  void add(const char *name, double wall, double cpu) {
+    for (auto &it : _passes)
+      if (it.name == name || std::strcmp(it.name, name) == 0) {
+        it.wall += wall;
+        it.cpu += cpu;
+        return;
+      }
+    _passes.push_back({name, wall, cpu});
+  }
+
+ private:
+  std::vector<Pass> _passes;
+};
+
+// 从构造到析构的时间记为名字是 name 的阶段，name 必须一直有效
+class ScopedTimer final {
+ public:
+  explicit ScopedTimer(const char *name)
+      : _times(PassTimes::current()),
+        _name(name),
+        _parent(nullptr),
+        _wall(),
+        _cpu(0),
+        _child_wall(0),
+        _child_cpu(0) {
+    if (_times == nullptr) return;
+    _parent = active();
+    active() = this;
+    _wall = std::chrono::steady_clock::now();
+    _cpu = std::clock();
+  }
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+  ~ScopedTimer() {
+    if (_times == nullptr) return;
+    std::chrono::duration<double> wall =
+        std::chrono::steady_clock::now() - _wall;
+    double cpu = static_cast<double>(std::clock() - _cpu) / CLOCKS_PER_SEC;
+    _times->add(_name, wall.count() - _child_wall, cpu - _child_cpu);
+    if (_parent != nullptr) {
+      _parent->_child_wall += wall.count();
+      _parent->_child_cpu += cpu;
+    }
+    active() = _parent;
+  }
+
+ private:
+  // 当前线程上最内层的计时器
+  static ScopedTimer *&active() {
+    thread_local ScopedTimer *timer = nullptr;
+    return timer;
+  }
+
+ private:
+  PassTimes *_times;
+  const char *_name;
+  ScopedTimer *_parent;
+  std::chrono::steady_clock::time_point _wall;
+  std::clock_t _cpu;
+  // 内层计时器的时间
+  double _child_wall;
+  double _child_cpu;
+};
+}  // namespace miniplc0
@@ -1,8 +1,383 @@
 #include "analyser/analyser.h"
+#include "ast/codegen.h"
 #include "catch2/catch.hpp"
+#include "generator/generator.h"
 #include "instruction/instruction.h"
 #include "tokenizer/tokenizer.h"
+#include "vm/vm.hpp"
 
-/*
-        不要忘记写测试用例喔。
-*/
+#include <cctype>
+#include <random>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace miniplc0;
+
+namespace {
+// 为了不依赖词法分析，直接手写 token 序列
+// 第 i 个 token 从偏移 10 * i 开始，这样错误的偏移的十位就是 token 的下标
+class TokenBuilder {
+ public:
+  TokenBuilder &add(TokenType type) {
+    return add(type, std::string(kKeywords[type]));
+  }
+  TokenBuilder &id(const std::string &s) {
+    return add(TokenType::IDENTIFIER, s);
+  }
+  TokenBuilder &num(int32_t v) {
+    _tokens.emplace_back(TokenType::UNSIGNED_INTEGER, v, _offset, _offset + 1);
+    _offset += kWidth;
+    return *this;
+  }
+  std::vector<Token> build() const { return _tokens; }
+
+ private:
+  TokenBuilder &add(TokenType type, const std::string &s) {
+    _tokens.emplace_back(type, s, _offset, _offset + s.size());
+    _offset += kWidth;
+    return *this;
+  }
+
+  static constexpr const char *kKeywords[] = {
+      "", "", "", "begin", "end", "var", "const", "print",
+      "+", "-", "*", "/", "=", ";", "(", ")"};
+  static constexpr uint32_t kWidth = 10;
+  std::vector<Token> _tokens;
+  uint32_t _offset = 0;
+};
+}  // namespace
+
+TEST_CASE("Analyse a correct program.") {
+  // begin const a = -2; var b; var c = a * (3 + a); b = c / a; print(b - 1);
+  // end
+  auto tks = TokenBuilder()
+                 .add(BEGIN)
+                 .add(CONST).id("a").add(EQUAL_SIGN).add(MINUS_SIGN).num(2)
+                 .add(SEMICOLON)
+                 .add(VAR).id("b").add(SEMICOLON)
+                 .add(VAR).id("c").add(EQUAL_SIGN).id("a")
+                 .add(MULTIPLICATION_SIGN).add(LEFT_BRACKET).num(3)
+                 .add(PLUS_SIGN).id("a").add(RIGHT_BRACKET).add(SEMICOLON)
+                 .id("b").add(EQUAL_SIGN).id("c").add(DIVISION_SIGN).id("a")
+                 .add(SEMICOLON)
+                 .add(SEMICOLON)
+                 .add(PRINT).add(LEFT_BRACKET).id("b").add(MINUS_SIGN).num(1)
+                 .add(RIGHT_BRACKET).add(SEMICOLON)
+                 .add(END)
+                 .build();
+  Analyser analyser(tks);
+  auto p = analyser.Analyse();
+  REQUIRE_FALSE(p.second.has_value());
+  VM vm(p.first);
+  REQUIRE(vm.Run() == std::vector<int32_t>{0});
+}
+
+TEST_CASE("Analyse stops at the first error.") {
+  // begin var a = ; print(b); end
+  auto tks = TokenBuilder()
+                 .add(BEGIN)
+                 .add(VAR).id("a").add(EQUAL_SIGN).add(SEMICOLON)
+                 .add(PRINT).add(LEFT_BRACKET).id("b").add(RIGHT_BRACKET)
+                 .add(SEMICOLON)
+                 .add(END)
+                 .build();
+  Analyser analyser(tks);
+  auto p = analyser.Analyse();
+  REQUIRE(p.first.empty());
+  REQUIRE(p.second.has_value());
+  REQUIRE(p.second.value() ==
+          CompilationError(41, ErrorCode::ErrIncompleteExpression));
+}
+
+TEST_CASE("Recover from errors and report all of them.") {
+  // begin
+  //   const = 1;
+  //   var a = ;
+  //   var b;
+  //   a = 1;
+  //   print(b;
+  //   var c;
+  //   1;
+  //   b = 2;
+  // end
+  auto tks = TokenBuilder()
+                 .add(BEGIN)                                            // 0
+                 .add(CONST).add(EQUAL_SIGN).num(1).add(SEMICOLON)      // 1-4
+                 .add(VAR).id("a").add(EQUAL_SIGN).add(SEMICOLON)       // 5-8
+                 .add(VAR).id("b").add(SEMICOLON)                       // 9-11
+                 .id("a").add(EQUAL_SIGN).num(1).add(SEMICOLON)         // 12-15
+                 .add(PRINT).add(LEFT_BRACKET).id("b").add(SEMICOLON)   // 16-19
+                 .add(VAR).id("c").add(SEMICOLON)                       // 20-22
+                 .num(1).add(SEMICOLON)                                 // 23-24
+                 .id("b").add(EQUAL_SIGN).num(2).add(SEMICOLON)         // 25-28
+                 .add(END)                                              // 29
+                 .build();
+  std::vector<CompilationError> expected = {
+      CompilationError(21, ErrorCode::ErrNeedIdentifier),
+      CompilationError(81, ErrorCode::ErrIncompleteExpression),
+      CompilationError(121, ErrorCode::ErrNotDeclared),
+      CompilationError(181, ErrorCode::ErrNotInitialized),
+      CompilationError(203, ErrorCode::ErrNoEnd),
+      CompilationError(231, ErrorCode::ErrNoEnd),
+  };
+
+  SECTION("all errors") {
+    Analyser analyser(tks);
+    auto p = analyser.AnalyseWithRecovery();
+    REQUIRE(p.first.empty());
+    REQUIRE(p.second == expected);
+  }
+  SECTION("the first error is the same as Analyse()") {
+    Analyser analyser(tks);
+    auto p = analyser.Analyse();
+    REQUIRE(p.second.has_value());
+    REQUIRE(p.second.value() == expected.front());
+  }
+  SECTION("the number of errors is bounded") {
+    Analyser analyser(tks);
+    auto p = analyser.AnalyseWithRecovery(3);
+    REQUIRE(p.second.size() == 3);
+    REQUIRE(std::equal(p.second.begin(), p.second.end(), expected.begin()));
+  }
+}
+
+TEST_CASE("Recover from a missing 'begin' and 'end'.") {
+  // var a = 1; print(a);
+  auto tks = TokenBuilder()
+                 .add(VAR).id("a").add(EQUAL_SIGN).num(1).add(SEMICOLON)
+                 .add(PRINT).add(LEFT_BRACKET).id("a").add(RIGHT_BRACKET)
+                 .add(SEMICOLON)
+                 .build();
+  Analyser analyser(tks);
+  auto p = analyser.AnalyseWithRecovery();
+  REQUIRE(p.second ==
+          std::vector<CompilationError>{
+              CompilationError(3, ErrorCode::ErrNoBegin),
+              CompilationError(91, ErrorCode::ErrNoEnd)});
+}
+
+namespace {
+// 随机生成一个嵌套 depth 层的表达式，每一层都有括号，a 的值是 1
+// 返回 <表达式，值，指令条数>
+std::tuple<std::string, int32_t, std::size_t> makeNestedExpression(
+    int depth, std::mt19937 &rng) {
+  // 每一层的前缀和后缀，以及这一层对值的变换和生成的指令条数
+  struct Level {
+    const char *prefix;
+    const char *suffix;
+    int32_t sign;
+    int32_t add;
+    std::size_t instructions;
+  };
+  static const Level levels[] = {
+      {"(", ")", 1, 0, 0},      {"-(", ")", -1, 0, 2},
+      {"(1-", ")", -1, 1, 2},   {"+(", "*a)", 1, 0, 2},
+      {"a*(", "/a)", 1, 0, 4},  {"(0+", ")-0", 1, 0, 4},
+  };
+  std::vector<int> chosen;
+  for (int i = 0; i < depth; i++) chosen.emplace_back(rng() % 6);
+  std::string s;
+  for (auto i : chosen) s += levels[i].prefix;
+  s += "a";
+  int32_t value = 1;
+  std::size_t instructions = 1;
+  for (auto it = chosen.rbegin(); it != chosen.rend(); ++it) {
+    s += levels[*it].suffix;
+    value = levels[*it].sign * value + levels[*it].add;
+    instructions += levels[*it].instructions;
+  }
+  return {s, value, instructions};
+}
+}  // namespace
+
+TEST_CASE("Deeply nested expressions do not overflow the stack.") {
+  std::mt19937 rng(2019);
+  auto analyse = [](const std::string &program) {
+    std::stringstream ss(program);
+    Tokenizer tkz(ss);
+    auto tokens = tkz.AllTokens();
+    REQUIRE_FALSE(tokens.second.has_value());
+    Analyser analyser(std::move(tokens.first));
+    return analyser.AnalyseWithRecovery();
+  };
+
+  SECTION("random shallow expressions") {
+    for (int i = 0; i < 100; i++) {
+      auto [expression, value, instructions] =
+          makeNestedExpression(rng() % 200, rng);
+      auto p = analyse("begin var a = 1; print(" + expression + "); end");
+      REQUIRE(p.second.empty());
+      // LIT 1; ...; WRT
+      REQUIRE(p.first.size() == instructions + 2);
+      VM vm(p.first);
+      REQUIRE(vm.Run() == std::vector<int32_t>{value});
+    }
+  }
+  SECTION("1000000 levels") {
+    auto [expression, value, instructions] =
+        makeNestedExpression(1000000, rng);
+    auto program = "begin var a = 1; print(" + expression + "); end";
+    auto p = analyse(program);
+    REQUIRE(p.second.empty());
+    REQUIRE(p.first.size() == instructions + 2);
+    REQUIRE(p.first.back() == Instruction(Operation::WRT, 0));
+
+    // 语法树同样没有递归
+    std::stringstream ss(program);
+    Tokenizer tkz(ss);
+    Analyser analyser(tkz.AllTokens().first);
+    REQUIRE(GenerateCode(analyser.AnalyseToAst().first) == p.first);
+
+    // 少一个 ')'，错误在 ';' 的后面
+    expression.pop_back();
+    while (expression.back() != ')') expression.pop_back();
+    expression.pop_back();
+    std::string prefix = "begin var a = 1; var b = ";
+    auto error = analyse(prefix + expression + "; end").second;
+    REQUIRE(error.size() == 1);
+    auto pos = prefix.size() + expression.size() + 1;
+    REQUIRE(error.front() ==
+            CompilationError(pos, ErrorCode::ErrIncompleteExpression));
+  }
+}
+
+namespace {
+// 一个编辑器：每次编辑之后增量地重新分析，并和从头分析的结果比较
+class Editor {
+ public:
+  explicit Editor(std::string text)
+      : _text(std::move(text)), _ss(_text), _tkz(_ss), _analyser({}) {
+    auto tokens = _tkz.AllTokens().first;
+    auto size = tokens.size();
+    _analyser.Reanalyse(std::move(tokens), 0, size);
+  }
+
+  void edit(std::size_t offset, std::size_t removed,
+            const std::string &inserted) {
+    _text.replace(offset, removed, inserted);
+    // 词法错误时没有 token，下一次编辑会重新分析全部内容
+    std::pair<std::size_t, std::size_t> relexed;
+    auto tokens = _tkz.Retokenize(_analyser.ReleaseTokens(), offset, removed,
+                                  inserted, &relexed)
+                      .first;
+    if (tokens.empty()) relexed = {0, 0};
+    Analyser fresh(tokens);
+    auto expected = fresh.AnalyseWithRecovery(3);
+    auto errors = _analyser.Reanalyse(std::move(tokens), relexed.first,
+                                      relexed.second, 3);
+    REQUIRE(errors == expected.second);
+    REQUIRE(_analyser.GetInstructions() == expected.first);
+  }
+  const std::string &text() const { return _text; }
+  const std::vector<Instruction> &instructions() const {
+    return _analyser.GetInstructions();
+  }
+
+ private:
+  std::string _text;
+  std::stringstream _ss;
+  Tokenizer _tkz;
+  Analyser _analyser;
+};
+}  // namespace
+
+TEST_CASE("Incremental analysis is the same as AnalyseWithRecovery().") {
+  Editor editor(
+      "begin\n"
+      "  const c = 3;\n"
+      "  var a;\n"
+      "  var b = 1;\n"
+      "  var x;\n"
+      "  a = b + 0;\n"
+      "  print(a * c);\n"
+      "  b = (a - b) / c;\n"
+      "  ;\n"
+      "  a = b + 4;\n"
+      "  print(a * c);\n"
+      "  b = (a - b) / c;\n"
+      "  ;\n"
+      "  a = b + 8;\n"
+      "  print(a * c);\n"
+      "  b = (a - b) / c;\n"
+      "  ;\n"
+      "  x = a;\n"
+      "  print(x);\n"
+      "end\n");
+  auto at = [&](const std::string &s) { return editor.text().find(s); };
+
+  // 修改一个常数
+  editor.edit(at("b + 8") + 4, 1, "42");
+  // 插入和删除语句
+  editor.edit(at("  print(a * c);"), 0, "  print(c);\n");
+  editor.edit(at("  ;\n"), 4, "");
+  // 改变第一次初始化 a 的语句，之后的语句才能同步
+  editor.edit(at("a = b + 0"), 1, "b");
+  editor.edit(at("b = b + 0"), 1, "a");
+  // 修改声明
+  editor.edit(at("c = 3"), 5, "c = 4");
+  editor.edit(at("  a = b + 0"), 0, "  var y;\n");
+  editor.edit(at("  var y;\n"), 8, "");
+  // 语法错误，以及修复它
+  editor.edit(at("print(c)") + 6, 1, "");
+  editor.edit(at("print(") + 6, 0, "c");
+  // 词法错误，以及修复它
+  editor.edit(at("x = a"), 0, "@");
+  editor.edit(at("@"), 1, "");
+  // 删掉 'end' 再加回来
+  editor.edit(at("end"), 3, "");
+  editor.edit(editor.text().size(), 0, "end");
+  REQUIRE_FALSE(editor.instructions().empty());
+}
+
+TEST_CASE("Random edits of a generated program.") {
+  GeneratorOptions options;
+  options.seed = 2019;
+  options.statements = 20;
+  Editor editor(GenerateProgram(options));
+  const char *pieces[] = {"v1", "c0", "1", " ", ";", "+", "=", "print(v1);"};
+  std::mt19937 rng(2019);
+  for (int i = 0; i < 300; i++) {
+    auto offset = rng() % (editor.text().size() + 1);
+    auto removed =
+        std::min<std::size_t>(rng() % 3, editor.text().size() - offset);
+    editor.edit(offset, removed, pieces[rng() % 8]);
+  }
+}
+
+TEST_CASE("Latency of incremental analysis.", "[.][benchmark]") {
+  GeneratorOptions options;
+  options.statements = 100000;
+  auto text = GenerateProgram(options);
+  // 中间的一个常数的开头
+  auto middle = static_cast<uint32_t>(text.size() / 2);
+  while (!std::isdigit(text[middle]) || std::isalnum(text[middle - 1]))
+    middle++;
+  std::stringstream ss(text);
+  Tokenizer tkz(ss);
+  auto tokens = tkz.AllTokens().first;
+  auto size = tokens.size();
+  // 第一次 Reanalyse() 分析全部 token，同时记录增量分析的缓存
+  Analyser analyser({});
+  analyser.Reanalyse(std::move(tokens), 0, size);
+  tokens = analyser.ReleaseTokens();
+
+  BENCHMARK("100000 statements, AnalyseWithRecovery()") {
+    Analyser full(tokens);
+    return full.AnalyseWithRecovery().first.size();
+  };
+  // 在一个常数前面插入一个数字再删掉
+  std::pair<std::size_t, std::size_t> relexed;
+  auto edit = [&](uint32_t removed, const char *s) {
+    tokens =
+        tkz.Retokenize(std::move(tokens), middle, removed, s, &relexed).first;
+    analyser.Reanalyse(std::move(tokens), relexed.first, relexed.second);
+    tokens = analyser.ReleaseTokens();
+  };
+  BENCHMARK("100000 statements, edit a line twice") {
+    edit(0, "1");
+    edit(1, "");
+    return analyser.GetInstructions().size();
+  };
+}
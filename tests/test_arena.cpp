@@ -0,0 +1,89 @@
+#include "analyser/analyser.h"
+#include "catch2/catch.hpp"
+#include "memory/arena.h"
+#include "tokenizer/tokenizer.h"
+
+#include <cstdint>
+#include <map>
+#include <memory_resource>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace miniplc0;
+
+TEST_CASE("Arena allocates aligned memory and counts it.") {
+  Arena arena;
+  auto a = arena.allocate(3, 1);
+  auto b = arena.allocate(8, 8);
+  auto c = arena.allocate(16, 16);
+  REQUIRE(reinterpret_cast<std::uintptr_t>(b) % 8 == 0);
+  REQUIRE(reinterpret_cast<std::uintptr_t>(c) % 16 == 0);
+  REQUIRE(static_cast<char *>(b) >= static_cast<char *>(a) + 3);
+  REQUIRE(arena.GetBytes() == 27);
+  REQUIRE(arena.GetAllocations() == 3);
+  REQUIRE(arena.GetReserved() == Arena::kChunkSize);
+
+  // 大的分配单独占一块，之后的小分配仍然使用当前块
+  auto big = arena.allocate(Arena::kChunkSize, 8);
+  auto d = static_cast<char *>(arena.allocate(1, 1));
+  REQUIRE(big != nullptr);
+  REQUIRE(d > static_cast<char *>(c));
+  REQUIRE(d < static_cast<char *>(c) + Arena::kChunkSize);
+  REQUIRE(arena.GetReserved() > 2 * Arena::kChunkSize);
+
+  arena.Release();
+  REQUIRE(arena.GetBytes() == 0);
+  REQUIRE(arena.GetAllocations() == 0);
+  REQUIRE(arena.GetReserved() == 0);
+}
+
+TEST_CASE("Arena works as a std::pmr::memory_resource.") {
+  Arena arena;
+  std::pmr::map<std::pmr::string, int> mp(&arena);
+  for (int i = 0; i < 1000; i++)
+    mp.emplace("a long name that does not fit in SSO " + std::to_string(i),
+               i);
+  REQUIRE(mp.size() == 1000);
+  REQUIRE(mp.find("a long name that does not fit in SSO 999")->second == 999);
+  REQUIRE(arena.GetAllocations() >= 2000);
+
+  SECTION("adopt another arena") {
+    Arena other;
+    auto s = other.CopyString("hello");
+    auto bytes = arena.GetBytes() + other.GetBytes();
+    arena.Adopt(other);
+    REQUIRE(std::string(s) == "hello");
+    REQUIRE(arena.GetBytes() == bytes);
+    REQUIRE(other.GetBytes() == 0);
+    REQUIRE(other.GetReserved() == 0);
+  }
+}
+
+TEST_CASE("Tokens and symbol tables are allocated from the arena.") {
+  Arena arena;
+  std::stringstream ss("begin var abc = 1; abc = abc + 1; print(abc); end");
+  Tokenizer tkz(ss, &arena);
+  auto tokens = tkz.AllTokens().first;
+  REQUIRE(tokens.size() == 18);
+  // 相同的标识符只复制一次
+  REQUIRE(tokens[2].GetValueView().data() == tokens[6].GetValueView().data());
+  REQUIRE(tokens[2].GetValueString() == "abc");
+  auto tokenizer_allocations = arena.GetAllocations();
+  REQUIRE(tokenizer_allocations > 0);
+
+  Analyser analyser(tokens, &arena);
+  auto p = analyser.AnalyseWithRecovery();
+  REQUIRE(p.second.empty());
+  REQUIRE(arena.GetAllocations() > tokenizer_allocations);
+
+  SECTION("parallel tokenization keeps the strings alive") {
+    std::string input;
+    for (int i = 0; i < 1000; i++) input += "a" + std::to_string(i) + " ";
+    std::stringstream long_ss(input);
+    Tokenizer parallel(long_ss, &arena);
+    auto result = parallel.AllTokensParallel(4, 64);
+    REQUIRE(result.first.size() == 1000);
+    REQUIRE(result.first.back().GetValueString() == "a999");
+  }
+}
@@ -0,0 +1,128 @@
+#include "analyser/analyser.h"
+#include "ast/ast.h"
+#include "ast/codegen.h"
+#include "catch2/catch.hpp"
+#include "memory/arena.h"
+#include "tokenizer/tokenizer.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace miniplc0;
+
+namespace {
+std::vector<Token> tokenize(const std::string &input, Arena &arena) {
+  std::stringstream ss(input);
+  Tokenizer tkz(ss, &arena);
+  auto p = tkz.AllTokens();
+  REQUIRE_FALSE(p.second.has_value());
+  return p.first;
+}
+}  // namespace
+
+TEST_CASE("Build the AST of a program.") {
+  Arena arena;
+  auto tokens = tokenize(
+      "begin\n"
+      "  const a = -2;\n"
+      "  var b;\n"
+      "  var c = -a * (3 + a);\n"
+      "  b = c / a;;\n"
+      "  print(b);\n"
+      "end\n",
+      arena);
+  Analyser analyser(tokens, &arena);
+  auto p = analyser.AnalyseToAst();
+  REQUIRE(p.second.empty());
+  auto &ast = p.first;
+  using Kind = Ast::Kind;
+
+  REQUIRE(ast.GetRoot() != Ast::kNone);
+  auto &program = ast.GetNode(ast.GetRoot());
+  REQUIRE(program.kind == Kind::Program);
+  // 空语句没有结点
+  std::vector<Ast::Node> statements;
+  for (auto it = program.lhs; it != Ast::kNone; it = ast.GetNode(it).rhs)
+    statements.emplace_back(ast.GetNode(it));
+  REQUIRE(statements.size() == 5);
+  REQUIRE(statements[0].kind == Kind::ConstDecl);
+  REQUIRE(statements[0].value == -2);
+  REQUIRE(statements[1].kind == Kind::VarDecl);
+  REQUIRE(statements[1].lhs == Ast::kNone);
+  REQUIRE(statements[3].kind == Kind::Assign);
+  REQUIRE(statements[3].value == 1);
+  REQUIRE(statements[3].offset == tokens[22].GetStartOffset());
+  REQUIRE(statements[4].kind == Kind::Print);
+
+  // -a * (3 + a)，括号没有结点
+  auto &mul = ast.GetNode(statements[2].lhs);
+  REQUIRE(mul.kind == Kind::Binary);
+  REQUIRE(mul.op == Operation::MUL);
+  auto &neg = ast.GetNode(mul.lhs);
+  REQUIRE(neg.kind == Kind::Negate);
+  REQUIRE(ast.GetNode(neg.lhs).kind == Kind::Variable);
+  REQUIRE(ast.GetNode(neg.lhs).value == 0);
+  auto &add = ast.GetNode(mul.rhs);
+  REQUIRE(add.kind == Kind::Binary);
+  REQUIRE(add.op == Operation::ADD);
+  REQUIRE(ast.GetNode(add.lhs).kind == Kind::Literal);
+  REQUIRE(ast.GetNode(add.lhs).value == 3);
+
+  // 生成的指令和直接分析的完全相同
+  Analyser direct(tokens, &arena);
+  REQUIRE(GenerateCode(ast) == direct.AnalyseWithRecovery().first);
+}
+
+TEST_CASE("Code generated from the AST is the same as Analyse().") {
+  Arena arena;
+  std::string input = "begin const c = +7; var x = 1; var y;\n";
+  for (int i = 0; i < 200; i++)
+    input += "y = -(x + " + std::to_string(i) + ") * c / -(-x - c);" +
+             (i % 3 ? "" : "print(x - y + c);") + "x = y;\n";
+  input += "end";
+  auto tokens = tokenize(input, arena);
+  Analyser analyser(tokens, &arena);
+  auto p = analyser.AnalyseToAst();
+  REQUIRE(p.second.empty());
+  Analyser direct(tokens, &arena);
+  REQUIRE(GenerateCode(p.first) == direct.AnalyseWithRecovery().first);
+
+  SECTION("the AST is empty when there are errors") {
+    tokens.pop_back();
+    Analyser bad(tokens, &arena);
+    auto q = bad.AnalyseToAst();
+    REQUIRE_FALSE(q.second.empty());
+    REQUIRE(q.first.NodeCount() == 0);
+    REQUIRE(GenerateCode(q.first).empty());
+  }
+}
+
+TEST_CASE("The source map points every instruction at its statement.") {
+  Arena arena;
+  auto tokens = tokenize(
+      "begin\n"
+      "  const a = 2;\n"
+      "  var b;\n"
+      "  b = a * 3;;\n"
+      "  print(b - a);\n"
+      "end\n",
+      arena);
+  Analyser analyser(tokens, &arena);
+  auto p = analyser.AnalyseToAst();
+  REQUIRE(p.second.empty());
+  SourceMap source_map;
+  auto v = GenerateCode(p.first, &source_map);
+  // 每个语句一段，空语句没有指令
+  REQUIRE(source_map.GetRuns().size() == 4);
+  REQUIRE(v.size() == 10);
+  auto b = tokens[9].GetStartOffset();
+  auto print = tokens[16].GetStartOffset();
+  REQUIRE(source_map.Find(2) == std::optional<std::uint32_t>(b));
+  REQUIRE(source_map.Find(5) == std::optional<std::uint32_t>(b));
+  REQUIRE(source_map.Find(6) == std::optional<std::uint32_t>(print));
+  REQUIRE(source_map.Find(9) == std::optional<std::uint32_t>(print));
+  REQUIRE(source_map.Find(100) == std::optional<std::uint32_t>(print));
+  REQUIRE(source_map.Find(0) == std::optional<std::uint32_t>(
+                                    tokens[1].GetStartOffset()));
+}
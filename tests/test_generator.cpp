@@ -0,0 +1,118 @@
+#include "analyser/analyser.h"
+#include "catch2/catch.hpp"
+#include "generator/generator.h"
+#include "tokenizer/tokenizer.h"
+#include "vm/vm.hpp"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace miniplc0;
+
+namespace {
+// 返回 <词法错误，语法和语义错误>
+std::pair<std::vector<CompilationError>, std::vector<CompilationError>>
+compile(const std::string &input) {
+  std::stringstream ss(input);
+  Tokenizer tkz(ss);
+  auto tokens = tkz.AllTokensWithRecovery(1000);
+  Analyser analyser(std::move(tokens.first));
+  return std::make_pair(tokens.second,
+                        analyser.AnalyseWithRecovery(1000).second);
+}
+}  // namespace
+
+TEST_CASE("Generated programs compile.") {
+  GeneratorOptions options;
+  options.statements = 200;
+  for (std::uint64_t seed = 0; seed < 50; seed++) {
+    options.seed = seed;
+    options.constants = seed % 3;
+    options.variables = seed % 7;
+    options.max_depth = seed % 6;
+    options.max_width = 1 + seed % 5;
+    options.identifier_length = seed % 10;
+    options.max_literal = seed % 2 ? 2147483647 : 9;
+    auto input = GenerateProgram(options);
+    INFO(input);
+    auto errors = compile(input);
+    REQUIRE(errors.first.empty());
+    REQUIRE(errors.second.empty());
+  }
+}
+
+TEST_CASE("Runnable programs run without errors.") {
+  GeneratorOptions options;
+  options.statements = 200;
+  options.runnable = true;
+  for (std::uint64_t seed = 0; seed < 50; seed++) {
+    options.seed = seed;
+    options.max_depth = seed % 8;
+    options.max_width = 1 + seed % 6;
+    options.max_literal = seed % 2 ? 2147483647 : 9;
+    auto input = GenerateProgram(options);
+    INFO(input);
+    std::stringstream ss(input);
+    Tokenizer tkz(ss);
+    auto tokens = tkz.AllTokens();
+    REQUIRE_FALSE(tokens.second.has_value());
+    Analyser analyser(std::move(tokens.first));
+    auto instructions = analyser.Analyse();
+    REQUIRE_FALSE(instructions.second.has_value());
+    VM vm(instructions.first);
+    REQUIRE_NOTHROW(vm.Run());
+  }
+}
+
+TEST_CASE("The same seed generates the same program.") {
+  GeneratorOptions options;
+  options.seed = 42;
+  options.identifier_length = 6;
+  auto input = GenerateProgram(options);
+  REQUIRE(input == GenerateProgram(options));
+  REQUIRE(input.find(" v00001 ") != std::string::npos);
+  options.seed = 43;
+  REQUIRE(input != GenerateProgram(options));
+}
+
+TEST_CASE("The generator streams its output in bounded chunks.") {
+  GeneratorOptions options;
+  options.statements = 100000;
+  std::size_t chunks = 0, bytes = 0;
+  ProgramGenerator generator(options);
+  generator.Generate([&](std::string_view chunk) {
+    REQUIRE(chunk.size() <= ProgramGenerator::kChunkSize);
+    chunks++;
+    bytes += chunk.size();
+  });
+  REQUIRE(chunks > 10);
+  REQUIRE(bytes == GenerateProgram(options).size());
+}
+
+TEST_CASE("Injected errors are reported.") {
+  GeneratorOptions options;
+  options.statements = 500;
+  options.seed = 7;
+
+  SECTION("lexical errors") {
+    options.lexical_error_rate = 0.05;
+    ProgramGenerator generator(options);
+    std::string input;
+    generator.Generate([&](std::string_view chunk) { input.append(chunk); });
+    REQUIRE(generator.GetErrorCount() > 0);
+    auto errors = compile(input);
+    REQUIRE(errors.first.size() == generator.GetErrorCount());
+  }
+  SECTION("syntax and semantic errors") {
+    options.syntax_error_rate = 0.05;
+    options.semantic_error_rate = 0.05;
+    ProgramGenerator generator(options);
+    std::string input;
+    generator.Generate([&](std::string_view chunk) { input.append(chunk); });
+    REQUIRE(generator.GetErrorCount() > 0);
+    auto errors = compile(input);
+    REQUIRE(errors.first.empty());
+    REQUIRE(errors.second.size() == generator.GetErrorCount());
+  }
+}
@@ -0,0 +1,47 @@
+#include "catch2/catch.hpp"
+#include "stats/memory.h"
+
+#include <memory>
+#include <new>
+#include <vector>
+
+using namespace miniplc0;
+
+// 只有构建时打开 MINIPLC0_COUNT_ALLOCATIONS 才有统计
+TEST_CASE("Heap usage is counted by phase.") {
+  if (!kCountAllocations) {
+    REQUIRE(GetHeapUsage().allocations == 0);
+    return;
+  }
+  HeapPhase phase;
+  auto before = GetHeapUsage();
+  {
+    std::vector<char> v(1 << 20);
+    auto p = std::make_unique<int[]>(10);
+    REQUIRE(GetHeapUsage().current >= before.current + (1 << 20));
+  }
+  auto usage = phase.Stop();
+  REQUIRE(usage.peak >= before.current + (1 << 20) + 10 * sizeof(int));
+  REQUIRE(usage.total >= (1 << 20) + 10 * sizeof(int));
+  REQUIRE(usage.allocations >= 2);
+  REQUIRE(usage.current <= before.current);
+
+  // 新的阶段从当前值开始统计峰值
+  HeapPhase next;
+  REQUIRE(next.Stop().peak < usage.peak);
+}
+
+TEST_CASE("Over-aligned allocations are counted.") {
+  if (!kCountAllocations) return;
+  struct alignas(256) Aligned {
+    char c;
+  };
+  HeapPhase phase;
+  auto p = std::make_unique<Aligned>();
+  REQUIRE(reinterpret_cast<std::uintptr_t>(p.get()) % 256 == 0);
+  REQUIRE(phase.Stop().total >= sizeof(Aligned));
+  p.reset();
+  auto q = new (std::nothrow) char[100];
+  REQUIRE(q != nullptr);
+  delete[] q;
+}
@@ -0,0 +1,213 @@
+#include "analyser/analyser.h"
+#include "ast/codegen.h"
+#include "ast/optimizer.h"
+#include "catch2/catch.hpp"
+#include "generator/generator.h"
+#include "memory/arena.h"
+#include "tokenizer/tokenizer.h"
+#include "vm/vm.hpp"
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace miniplc0;
+
+namespace {
+// 返回 <优化前的指令，优化后的指令>
+std::pair<std::vector<Instruction>, std::vector<Instruction>> compile(
+    const std::string &input, void (*pass)(Ast &)) {
+  Arena arena;
+  std::stringstream ss(input);
+  Tokenizer tkz(ss, &arena);
+  auto tokens = tkz.AllTokens();
+  REQUIRE_FALSE(tokens.second.has_value());
+  Analyser analyser(std::move(tokens.first), &arena);
+  auto p = analyser.AnalyseToAst();
+  REQUIRE(p.second.empty());
+  auto before = GenerateCode(p.first);
+  pass(p.first);
+  return std::make_pair(before, GenerateCode(p.first));
+}
+
+// 运行时出错返回空
+std::optional<std::vector<int32_t>> run(const std::vector<Instruction> &v) {
+  try {
+    VM vm(v);
+    // 编译器生成的指令总是能通过验证
+    REQUIRE(vm.IsVerified());
+    return vm.Run();
+  } catch (const std::out_of_range &) {
+    return {};
+  }
+}
+
+// 一个小的随机程序，常数有时很大，所以运行时可能溢出或者除以 0
+std::string makeRandomProgram(std::uint64_t seed) {
+  GeneratorOptions options;
+  options.seed = seed;
+  options.constants = 1 + seed % 2;
+  options.variables = 2 + seed % 4;
+  options.statements = seed % 12;
+  options.max_depth = seed % 3;
+  options.max_width = 1 + seed % 4;
+  options.max_literal = seed % 4 == 0 ? 2147483647 : 9;
+  return GenerateProgram(options);
+}
+}  // namespace
+
+TEST_CASE("Eliminate dead stores and unused variables.") {
+  auto p = compile(
+      "begin\n"
+      "  const unused = 5;\n"
+      "  const k = 2;\n"
+      "  var a = 1;\n"
+      "  var b;\n"
+      "  var c = 3;\n"
+      "  a = 10;\n"
+      "  a = k * 4;\n"
+      "  print(a + c);\n"
+      "  c = 7;\n"
+      "end\n",
+      EliminateDeadStores);
+  // unused 和 b 被删掉，a 的初始值和两个赋值都不会被读取
+  REQUIRE(p.second == std::vector<Instruction>{
+                          {Operation::LIT, 2},
+                          {Operation::LIT, 0},
+                          {Operation::LIT, 3},
+                          {Operation::LOD, 0},
+                          {Operation::LIT, 4},
+                          {Operation::MUL, 0},
+                          {Operation::STO, 1},
+                          {Operation::LOD, 1},
+                          {Operation::LOD, 2},
+                          {Operation::ADD, 0},
+                          {Operation::WRT, 0},
+                      });
+  REQUIRE(run(p.first) == run(p.second));
+}
+
+TEST_CASE("Dead stores that may trap are kept.") {
+  auto p = compile(
+      "begin\n"
+      "  var x;\n"
+      "  var y = 2147483647 + 1;\n"
+      "  var z = 1;\n"
+      "  x = 1 / 0;\n"
+      "  x = z * 2;\n"
+      "  x = 5;\n"
+      "  print(3);\n"
+      "end\n",
+      EliminateDeadStores);
+  // 只有 x = 5 被删掉，z 仍然被读取
+  REQUIRE(p.second.size() + 2 == p.first.size());
+  REQUIRE_FALSE(run(p.second).has_value());
+}
+
+TEST_CASE("Propagate constants through variables.") {
+  std::string input =
+      "begin\n"
+      "  const k = 3;\n"
+      "  var a = k * 2;\n"
+      "  var b;\n"
+      "  var big = 2147483647;\n"
+      "  b = a + 1;\n"
+      "  print(b * a);\n"
+      "  a = big;\n"
+      "  print(a + 1);\n"
+      "end\n";
+  SECTION("propagation only") {
+    auto p = compile(input, PropagateConstants);
+    REQUIRE(p.second == std::vector<Instruction>{
+                            {Operation::LIT, 3},
+                            {Operation::LIT, 6},
+                            {Operation::LIT, 0},
+                            {Operation::LIT, 2147483647},
+                            {Operation::LIT, 7},
+                            {Operation::STO, 2},
+                            {Operation::LIT, 42},
+                            {Operation::WRT, 0},
+                            {Operation::LIT, 2147483647},
+                            {Operation::STO, 1},
+                            {Operation::LIT, 2147483647},
+                            {Operation::LIT, 1},
+                            {Operation::ADD, 0},
+                            {Operation::WRT, 0},
+                        });
+  }
+  SECTION("with dead store elimination") {
+    // 所有的变量都不再被读取，溢出仍然留到运行时
+    auto p = compile(input, Optimize);
+    REQUIRE(p.second == std::vector<Instruction>{
+                            {Operation::LIT, 42},
+                            {Operation::WRT, 0},
+                            {Operation::LIT, 2147483647},
+                            {Operation::LIT, 1},
+                            {Operation::ADD, 0},
+                            {Operation::WRT, 0},
+                        });
+    REQUIRE_FALSE(run(p.first).has_value());
+    REQUIRE_FALSE(run(p.second).has_value());
+  }
+}
+
+TEST_CASE("Optimized programs print the same values.") {
+  std::size_t before = 0, after = 0;
+  for (std::uint64_t seed = 0; seed < 500; seed++) {
+    auto input = makeRandomProgram(seed);
+    auto p = compile(input, Optimize);
+    INFO(input);
+    REQUIRE(p.second.size() <= p.first.size());
+    REQUIRE(run(p.first) == run(p.second));
+    before += p.first.size();
+    after += p.second.size();
+  }
+  REQUIRE(after < before);
+}
+
+TEST_CASE("Instruction count on a corpus.", "[.][benchmark]") {
+  std::vector<std::string> corpus;
+  for (std::uint64_t seed = 0; seed < 2000; seed++)
+    corpus.emplace_back(makeRandomProgram(seed));
+
+  // 每个优化单独运行以及一起运行时的指令条数
+  struct {
+    const char *name;
+    void (*pass)(Ast &);
+    std::size_t count;
+  } passes[] = {
+      {"PropagateConstants()", PropagateConstants, 0},
+      {"EliminateDeadStores()", EliminateDeadStores, 0},
+      {"Optimize()", Optimize, 0},
+  };
+  std::size_t before = 0;
+  for (auto &input : corpus) {
+    for (auto &it : passes) {
+      auto p = compile(input, it.pass);
+      if (&it == passes) before += p.first.size();
+      it.count += p.second.size();
+    }
+  }
+  std::stringstream report;
+  report << "Instructions before optimization: " << before;
+  for (auto &it : passes)
+    report << "\n" << it.name << ": " << it.count << " ("
+           << 100.0 * (before - it.count) / before << "% fewer)";
+  WARN(report.str());
+
+  auto analyse = [&](bool optimize) {
+    std::size_t count = 0;
+    for (auto &input : corpus) {
+      std::stringstream ss(input);
+      Tokenizer tkz(ss);
+      Analyser analyser(tkz.AllTokens().first);
+      auto ast = analyser.AnalyseToAst().first;
+      if (optimize) Optimize(ast);
+      count += GenerateCode(ast).size();
+    }
+    return count;
+  };
+  BENCHMARK("2000 programs, without optimization") { return analyse(false); };
+  BENCHMARK("2000 programs, with Optimize()") { return analyse(true); };
+}
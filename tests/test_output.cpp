@@ -0,0 +1,127 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "fmt/core.h"
+#include "fmts.hpp"
+#include "instruction/instruction.h"
+#include "output/writer.hpp"
+#include "tokenizer/tokenizer.h"
+
+namespace {
+std::vector<miniplc0::Instruction> makeInstructions(std::size_t n) {
+  std::vector<miniplc0::Instruction> v;
+  v.reserve(n);
+  for (std::size_t i = 0; i < n; i++) {
+    auto x = static_cast<std::int32_t>(i);
+    switch (i % 4) {
+      case 0:
+        v.emplace_back(miniplc0::Operation::LIT, x);
+        break;
+      case 1:
+        v.emplace_back(miniplc0::Operation::LOD, x % 1024);
+        break;
+      case 2:
+        v.emplace_back(miniplc0::Operation::ADD, 0);
+        break;
+      default:
+        v.emplace_back(miniplc0::Operation::STO, x % 1024);
+        break;
+    }
+  }
+  return v;
+}
+
+std::string readBack(std::FILE *f) {
+  std::string s;
+  std::rewind(f);
+  char buf[4096];
+  for (std::size_t n; (n = std::fread(buf, 1, sizeof(buf), f)) > 0;)
+    s.append(buf, n);
+  return s;
+}
+
+#ifdef _WIN32
+const char *kNullDevice = "NUL";
+#else
+const char *kNullDevice = "/dev/null";
+#endif
+}  // namespace
+
+TEST_CASE("Text of the formatters.") {
+  using namespace miniplc0;
+  REQUIRE(fmt::format("{}", Instruction(Operation::ILL, 0)) == "ILL");
+  REQUIRE(fmt::format("{}", Instruction(Operation::LIT, -2147483647 - 1)) ==
+          "LIT -2147483648");
+  REQUIRE(fmt::format("{}", Instruction(Operation::LOD, 3)) == "LOD 3");
+  REQUIRE(fmt::format("{}", Instruction(Operation::STO, 0)) == "STO 0");
+  REQUIRE(fmt::format("{}", Instruction(Operation::DIV, 7)) == "DIV");
+  REQUIRE(fmt::format("{}", Instruction(Operation::WRT, 0)) == "WRT");
+  REQUIRE(fmt::format("{}", TokenType::RIGHT_BRACKET) == "RightBracket");
+  REQUIRE(fmt::format("{}", ErrorCode::ErrNoSemicolon) ==
+          "Zai? Wei shen me bu xie fen hao.");
+  auto tk = Token(TokenType::IDENTIFIER, std::string("a1"), 8, 10);
+  REQUIRE(fmt::format("{}", Located<Token>(tk, {1, 2})) ==
+          "Line: 1 Column: 2 Type: Identifier Value: a1");
+  auto err = CompilationError(5, ErrorCode::ErrEOF);
+  REQUIRE(fmt::format("{}", Located<CompilationError>(err, {0, 5})) ==
+          "Line: 0 Column: 5 Error: EOF");
+}
+
+TEST_CASE("Diagnostics with source snippets.") {
+  using namespace miniplc0;
+  std::stringstream ss("begin\n\tvar a = 1 @;\nend\n");
+  Tokenizer tkz(ss);
+  auto p = tkz.AllTokens();
+  REQUIRE(p.second.has_value());
+  auto err = p.second.value();
+  REQUIRE(tkz.GetLine(1) == "\tvar a = 1 @;");
+  REQUIRE(tkz.GetLine(3).empty());
+  REQUIRE(tkz.GetPos(err.GetOffset()) == std::pair<uint64_t, uint64_t>(1, 11));
+  REQUIRE(fmt::format("{}", tkz.GetDiagnostic(err)) ==
+          "Line: 1 Column: 11 Error: The input is invalid.\n"
+          "\tvar a = 1 @;\n"
+          "\t          ^");
+  // 没有源代码时和 Located<CompilationError> 一样
+  REQUIRE(fmt::format("{}", Diagnostic(err, {1, 11}, "")) ==
+          fmt::format("{}", Located<CompilationError>(err, {1, 11})));
+}
+
+TEST_CASE("OutputWriter produces the same text as fmt::format.") {
+  auto v = makeInstructions(10000);
+  std::string expected;
+  for (auto &it : v) expected += fmt::format("{}\n", it);
+
+  // 用一个很小的缓冲区，保证会发生多次 flush
+  std::FILE *f = std::tmpfile();
+  REQUIRE(f != nullptr);
+  {
+    miniplc0::OutputWriter output(fileno(f), 128);
+    for (auto &it : v) output.WriteLine(it);
+    REQUIRE(output.Flush());
+  }
+  REQUIRE(readBack(f) == expected);
+  std::fclose(f);
+}
+
+TEST_CASE("Output of 1M instructions.", "[.][benchmark]") {
+  auto v = makeInstructions(1000000);
+  std::FILE *f = std::fopen(kNullDevice, "wb");
+  REQUIRE(f != nullptr);
+  std::ofstream ofs(kNullDevice);
+
+  BENCHMARK("ostream << fmt::format") {
+    for (auto &it : v) ofs << fmt::format("{}\n", it);
+    ofs.flush();
+  };
+
+  BENCHMARK("OutputWriter") {
+    miniplc0::OutputWriter output(fileno(f));
+    for (auto &it : v) output.WriteLine(it);
+    return output.Flush();
+  };
+  std::fclose(f);
+}
@@ -0,0 +1,84 @@
+#include "catch2/catch.hpp"
+#include "instruction/instruction.h"
+#include "instruction/source_map.h"
+#include "vm/profile.hpp"
+#include "vm/vm.hpp"
+
+#include <vector>
+
+using namespace miniplc0;
+
+TEST_CASE("VMProfile counts operations, instructions and pairs.") {
+  VMProfile profile;
+  // LIT 1; LIT 2; ADD; WRT，运行两次
+  for (int run = 0; run < 2; run++) {
+    profile.Begin(4);
+    profile.Step(0, LIT);
+    profile.Step(1, LIT);
+    profile.Step(2, ADD);
+    profile.Step(3, WRT);
+    profile.End();
+  }
+  REQUIRE(profile.GetOperation(LIT).count == 4);
+  REQUIRE(profile.GetOperation(ADD).count == 2);
+  REQUIRE(profile.GetOperation(WRT).count == 2);
+  REQUIRE(profile.GetOperation(STO).count == 0);
+  REQUIRE(profile.GetInstruction(1).count == 2);
+  REQUIRE(profile.GetPair(LIT, LIT) == 2);
+  REQUIRE(profile.GetPair(LIT, ADD) == 2);
+  REQUIRE(profile.GetPair(ADD, WRT) == 2);
+  // 两次运行之间不算一个组合
+  REQUIRE(profile.GetPair(WRT, LIT) == 0);
+  REQUIRE(profile.PairsByCount().size() == 3);
+  REQUIRE(profile.OperationsByTicks().size() == 3);
+  REQUIRE(profile.HottestInstructions(2).size() == 2);
+  REQUIRE(profile.HottestInstructions(10).size() == 4);
+}
+
+TEST_CASE("The VM reports to the profile in a profiling build.") {
+  std::vector<Instruction> v = {{LIT, 6}, {LIT, 7}, {MUL, 0}, {WRT, 0}};
+  VMProfile profile;
+  VM vm(v);
+  vm.SetProfile(&profile);
+  REQUIRE(vm.Run() == std::vector<std::int32_t>{42});
+  auto expected = kProfileVM ? 1 : 0;
+  REQUIRE(profile.GetOperation(MUL).count == expected);
+  REQUIRE(profile.GetPair(LIT, MUL) == expected);
+  REQUIRE(profile.GetInstructionCount() == (kProfileVM ? v.size() : 0));
+  if (kProfileVM) REQUIRE(profile.GetInstruction(3).count == 1);
+}
+
+TEST_CASE("SourceMap merges and overwrites runs.") {
+  SourceMap source_map;
+  REQUIRE_FALSE(source_map.Find(0).has_value());
+  source_map.Add(0, 10);
+  source_map.Add(2, 10);
+  // 空的一段被覆盖
+  source_map.Add(3, 20);
+  source_map.Add(3, 30);
+  REQUIRE(source_map.GetRuns().size() == 2);
+  REQUIRE(source_map.Find(2) == std::optional<std::uint32_t>(10));
+  REQUIRE(source_map.Find(3) == std::optional<std::uint32_t>(30));
+}
+
+TEST_CASE("VMProfile attributes instructions to statements.") {
+  SourceMap source_map;
+  source_map.Add(0, 5);
+  source_map.Add(2, 9);
+  VMProfile profile;
+  profile.Begin(4);
+  profile.Step(0, LIT);
+  profile.Step(1, LIT);
+  profile.Step(2, LOD);
+  profile.Step(3, WRT);
+  profile.End();
+  auto sources = profile.BySource(source_map);
+  REQUIRE(sources.size() == 2);
+  REQUIRE(sources[0].offset == 5);
+  REQUIRE(sources[0].entry.count == 2);
+  REQUIRE(sources[1].offset == 9);
+  REQUIRE(sources[1].entry.count == 2);
+  REQUIRE(sources[0].entry.ticks + sources[1].entry.ticks ==
+          profile.GetOperation(LIT).ticks + profile.GetOperation(LOD).ticks +
+              profile.GetOperation(WRT).ticks);
+}
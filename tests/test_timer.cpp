@@ -0,0 +1,65 @@
+#include "catch2/catch.hpp"
+#include "stats/timer.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+using namespace miniplc0;
+
+namespace {
+void sleep(int ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+const PassTimes::Pass *find(const PassTimes &times, const std::string &name) {
+  for (auto &it : times.GetPasses())
+    if (name == it.name) return &it;
+  return nullptr;
+}
+}  // namespace
+
+TEST_CASE("Nested timers are exclusive.") {
+  PassTimes times;
+  times.Install();
+  {
+    ScopedTimer outer("outer");
+    sleep(20);
+    {
+      ScopedTimer inner("inner");
+      sleep(50);
+    }
+  }
+  times.Uninstall();
+  auto outer = find(times, "outer");
+  auto inner = find(times, "inner");
+  REQUIRE(outer != nullptr);
+  REQUIRE(inner != nullptr);
+  REQUIRE(times.GetPasses().size() == 2);
+  REQUIRE(inner->wall >= 0.05);
+  REQUIRE(outer->wall >= 0.02);
+  REQUIRE(outer->wall < 0.05);
+}
+
+TEST_CASE("Timers with the same name are added up.") {
+  PassTimes times;
+  times.Install();
+  for (int i = 0; i < 3; i++) {
+    ScopedTimer timer("pass");
+    sleep(5);
+  }
+  std::string name = "pass";
+  { ScopedTimer timer(name.c_str()); }
+  times.Uninstall();
+  REQUIRE(times.GetPasses().size() == 1);
+  REQUIRE(times.GetPasses()[0].wall >= 0.015);
+}
+
+TEST_CASE("Timers do nothing without an installed PassTimes.") {
+  PassTimes times;
+  times.Install();
+  std::thread([] { ScopedTimer timer("other thread"); }).join();
+  times.Uninstall();
+  { ScopedTimer timer("uninstalled"); }
+  REQUIRE(times.GetPasses().empty());
+}
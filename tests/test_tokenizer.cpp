@@ -1,8 +1,11 @@
 #include "catch2/catch.hpp"
 #include "fmt/core.h"
+#include "generator/generator.h"
 #include "tokenizer/tokenizer.h"
 
 
+#include <algorithm>
+#include <random>
 #include <sstream>
 #include <vector>
 
@@ -26,3 +29,291 @@ TEST_CASE("Test hello world.") {
   REQUIRE( (result.first == output) );
   */
 }
+
+TEST_CASE("Tokenize a program.") {
+  std::string input =
+      "begin\n"
+      "  var a1 = 12;\n"
+      "  print(-a1*(3/a1));\n"
+      "end";
+  std::stringstream ss;
+  ss.str(input);
+  miniplc0::Tokenizer tkz(ss);
+  auto result = tkz.AllTokens();
+  REQUIRE_FALSE(result.second.has_value());
+  using namespace miniplc0;
+  std::vector<Token> output = {
+      Token(BEGIN, std::string("begin"), 0, 5),
+      Token(VAR, std::string("var"), 8, 11),
+      Token(IDENTIFIER, std::string("a1"), 12, 14),
+      Token(EQUAL_SIGN, '=', 15, 16),
+      Token(UNSIGNED_INTEGER, 12, 17, 19),
+      Token(SEMICOLON, ';', 19, 20),
+      Token(PRINT, std::string("print"), 23, 28),
+      Token(LEFT_BRACKET, '(', 28, 29),
+      Token(MINUS_SIGN, '-', 29, 30),
+      Token(IDENTIFIER, std::string("a1"), 30, 32),
+      Token(MULTIPLICATION_SIGN, '*', 32, 33),
+      Token(LEFT_BRACKET, '(', 33, 34),
+      Token(UNSIGNED_INTEGER, 3, 34, 35),
+      Token(DIVISION_SIGN, '/', 35, 36),
+      Token(IDENTIFIER, std::string("a1"), 36, 38),
+      Token(RIGHT_BRACKET, ')', 38, 39),
+      Token(RIGHT_BRACKET, ')', 39, 40),
+      Token(SEMICOLON, ';', 40, 41),
+      Token(END, std::string("end"), 42, 45),
+  };
+  REQUIRE((result.first == output));
+}
+
+TEST_CASE("Recover from lexical errors.") {
+  std::string input =
+      "begin\n"
+      "  var a = 2147483648 @ 2147483647;\n"
+      "  var 1b;\n"
+      "end";
+  using namespace miniplc0;
+  std::vector<CompilationError> expected = {
+      CompilationError(16, ErrorCode::ErrIntegerOverflow),
+      CompilationError(27, ErrorCode::ErrInvalidInput),
+      CompilationError(47, ErrorCode::ErrInvalidIdentifier),
+  };
+
+  SECTION("the first error is the same as AllTokens()") {
+    std::stringstream ss(input);
+    Tokenizer tkz(ss);
+    auto result = tkz.AllTokens();
+    REQUIRE(result.first.empty());
+    REQUIRE(result.second.value() == expected.front());
+  }
+  SECTION("all errors") {
+    std::stringstream ss(input);
+    Tokenizer tkz(ss);
+    auto result = tkz.AllTokensWithRecovery();
+    REQUIRE(result.second == expected);
+    REQUIRE(result.first.size() == 12);
+    REQUIRE(result.first[4] ==
+            Token(NULL_TOKEN, std::string("2147483648"), 16, 26));
+    REQUIRE(result.first[5] == Token(NULL_TOKEN, '@', 27, 28));
+    REQUIRE(result.first[6] ==
+            Token(UNSIGNED_INTEGER, 2147483647, 29, 39));
+    REQUIRE(result.first[9] ==
+            Token(IDENTIFIER, std::string("1b"), 47, 49));
+  }
+  SECTION("the number of errors is bounded") {
+    std::stringstream ss(input);
+    Tokenizer tkz(ss);
+    auto result = tkz.AllTokensWithRecovery(2);
+    REQUIRE(result.second.size() == 2);
+  }
+}
+
+TEST_CASE("All kinds of line breaks.") {
+  using namespace miniplc0;
+  auto positions = [](const std::string &input) {
+    std::stringstream ss(input);
+    Tokenizer tkz(ss);
+    auto result = tkz.AllTokens();
+    REQUIRE_FALSE(result.second.has_value());
+    std::vector<std::pair<uint64_t, uint64_t>> v;
+    for (auto &it : result.first) v.emplace_back(tkz.Locate(it).GetPos());
+    return v;
+  };
+  std::vector<std::pair<uint64_t, uint64_t>> expected = {
+      {0, 0}, {1, 1}, {1, 5}, {1, 6}, {3, 0}};
+  REQUIRE(positions("begin\n var a;\n\nend\n") == expected);
+  REQUIRE(positions("begin\r\n var a;\r\n\r\nend") == expected);
+  REQUIRE(positions("begin\r var a;\r\rend\r") == expected);
+  REQUIRE(positions("begin\r\n var a;\n\rend") == expected);
+}
+
+namespace {
+// 一个很长的生成的程序，换行依次换成各种换行
+std::string makeLongProgram(std::uint64_t statements) {
+  miniplc0::GeneratorOptions options;
+  options.seed = 2019;
+  options.statements = statements;
+  const char *breaks[] = {"\n", "\r\n", "\r", " \t\n"};
+  std::string s;
+  std::size_t lines = 0;
+  for (auto c : miniplc0::GenerateProgram(options)) {
+    if (c == '\n')
+      s += breaks[lines++ % 4];
+    else
+      s += c;
+  }
+  return s;
+}
+
+// 并行分析出错时返回和串行分析相同的错误，并且指针和行表都没有改变
+// 之后再调用 AllTokensWithRecovery() 的结果和串行分析完全相同
+void checkParallelError(const std::string &input, std::size_t threads,
+                        std::size_t chunk) {
+  using namespace miniplc0;
+  std::stringstream serial_ss(input);
+  Tokenizer serial(serial_ss);
+  auto err = serial.AllTokens().second;
+  REQUIRE(err.has_value());
+  std::stringstream serial_recovery_ss(input);
+  Tokenizer serial_recovery(serial_recovery_ss);
+  auto expected = serial_recovery.AllTokensWithRecovery();
+
+  std::stringstream ss(input);
+  Tokenizer tkz(ss);
+  auto result = tkz.AllTokensParallel(threads, chunk);
+  REQUIRE(result.first.empty());
+  REQUIRE(result.second == err);
+  auto recovered = tkz.AllTokensWithRecovery();
+  REQUIRE(recovered.second == expected.second);
+  REQUIRE((recovered.first == expected.first));
+  bool same_pos = true;
+  for (auto &it : recovered.first)
+    same_pos &= tkz.Locate(it).GetPos() == serial_recovery.Locate(it).GetPos();
+  REQUIRE(same_pos);
+}
+}  // namespace
+
+TEST_CASE("Parallel tokenization is the same as AllTokens().") {
+  using namespace miniplc0;
+  auto input = makeLongProgram(1000);
+  std::stringstream serial_ss(input);
+  Tokenizer serial(serial_ss);
+  auto expected = serial.AllTokens();
+  REQUIRE_FALSE(expected.second.has_value());
+
+  for (std::size_t threads : {1, 2, 3, 8}) {
+    for (std::size_t chunk : {1, 7, 4096}) {
+      std::stringstream ss(input);
+      Tokenizer tkz(ss);
+      auto result = tkz.AllTokensParallel(threads, chunk);
+      REQUIRE_FALSE(result.second.has_value());
+      REQUIRE((result.first == expected.first));
+      bool same_pos = true;
+      for (auto &it : result.first)
+        same_pos &= tkz.Locate(it).GetPos() == serial.Locate(it).GetPos();
+      REQUIRE(same_pos);
+    }
+  }
+
+  SECTION("the same error") {
+    input[input.size() / 2] = '@';
+    // 多个块并行分析，以及只有一个块时退回到 AllTokens()
+    checkParallelError(input, 4, 16);
+    checkParallelError(input, 4, Tokenizer::kMinChunkSize);
+  }
+}
+
+TEST_CASE("Parallel tokenization of a small file with an error.") {
+  checkParallelError("begin\n var a = 1;\n a = a @ 1;\n print(a);\nend\n", 2,
+                     miniplc0::Tokenizer::kMinChunkSize);
+}
+
+TEST_CASE("Scaling of parallel tokenization.", "[.][benchmark]") {
+  auto input = makeLongProgram(100000);
+  for (std::size_t threads : {1, 2, 4, 8}) {
+    BENCHMARK(fmt::format("{} MB, {} threads", input.size() >> 20, threads)) {
+      std::stringstream ss(input);
+      miniplc0::Tokenizer tkz(ss);
+      return tkz.AllTokensParallel(threads, 1 << 16).first.size();
+    };
+  }
+}
+
+namespace {
+// 对编辑之后的源代码从头分析一遍，作为增量分析的标准答案
+void checkRetokenize(miniplc0::Tokenizer &tkz,
+                     std::vector<miniplc0::Token> &tokens, std::string &input,
+                     uint32_t offset, uint32_t removed,
+                     const std::string &inserted) {
+  using namespace miniplc0;
+  input.replace(offset, removed, inserted);
+  std::stringstream ss(input);
+  Tokenizer fresh(ss);
+  auto expected = fresh.AllTokens();
+  auto result = tkz.Retokenize(std::move(tokens), offset, removed, inserted);
+  REQUIRE(result.second == expected.second);
+  REQUIRE((result.first == expected.first));
+  tokens = std::move(result.first);
+  // 出错时 fresh 没有读完整个行表
+  if (expected.second.has_value()) return;
+  bool same_pos = true;
+  for (uint32_t i = 0; i <= input.size(); i++)
+    same_pos &= tkz.GetPos(i) == fresh.GetPos(i);
+  REQUIRE(same_pos);
+}
+}  // namespace
+
+TEST_CASE("Incremental tokenization is the same as AllTokens().") {
+  using namespace miniplc0;
+  std::string input = "begin\r\n  var a = 1;\r  b = a+23;\n  print(b);\nend\n";
+  std::stringstream ss(input);
+  Tokenizer tkz(ss);
+  auto tokens = tkz.AllTokens().first;
+
+  // 在标识符中间插入
+  checkRetokenize(tkz, tokens, input, 12, 0, "bc");
+  // 删除空格，两个 token 合并
+  checkRetokenize(tkz, tokens, input, 11, 1, "");
+  // 拆开一个 token
+  checkRetokenize(tkz, tokens, input, 27, 0, " ");
+  // \r 后面插入 \n，两行合并成一个换行
+  checkRetokenize(tkz, tokens, input, 21, 0, "\n");
+  // 删除 \r\n 中的 \r
+  checkRetokenize(tkz, tokens, input, 5, 1, "");
+  // 开头和结尾
+  checkRetokenize(tkz, tokens, input, 0, 0, "const x = 0;\n");
+  checkRetokenize(tkz, tokens, input, input.size(), 0, "\r");
+  checkRetokenize(tkz, tokens, input, input.size() - 1, 1, "");
+  // 引入一个错误，再从头分析
+  checkRetokenize(tkz, tokens, input, 8, 0, "@");
+  REQUIRE(tokens.empty());
+  checkRetokenize(tkz, tokens, input, 8, 1, "");
+
+  SECTION("without old tokens") {
+    // 还没有扫描过，行表中只有第一行
+    std::stringstream fresh_ss(input);
+    Tokenizer fresh(fresh_ss);
+    std::vector<Token> none;
+    checkRetokenize(fresh, none, input, 20, 0, "\n a = 2;");
+  }
+
+  SECTION("random edits") {
+    const char pieces[] = "ab 1\r\n;+=(";
+    std::mt19937 rng(2019);
+    input = makeLongProgram(50);
+    std::stringstream long_ss(input);
+    Tokenizer long_tkz(long_ss);
+    tokens = long_tkz.AllTokens().first;
+    for (int i = 0; i < 200; i++) {
+      auto offset = static_cast<uint32_t>(rng() % (input.size() + 1));
+      auto removed = static_cast<uint32_t>(
+          std::min<std::size_t>(rng() % 4, input.size() - offset));
+      std::string inserted;
+      for (auto n = rng() % 4; n > 0; n--)
+        inserted += pieces[rng() % (sizeof(pieces) - 1)];
+      checkRetokenize(long_tkz, tokens, input, offset, removed, inserted);
+    }
+  }
+}
+
+TEST_CASE("Latency of incremental tokenization.", "[.][benchmark]") {
+  using namespace miniplc0;
+  auto input = makeLongProgram(40000);
+  std::stringstream ss(input);
+  Tokenizer tkz(ss);
+  auto tokens = tkz.AllTokens().first;
+  auto middle = static_cast<uint32_t>(input.size() / 2);
+  middle = static_cast<uint32_t>(input.find(" v", middle)) + 2;
+
+  BENCHMARK(fmt::format("{} MB, AllTokens()", input.size() >> 20)) {
+    std::stringstream full_ss(input);
+    Tokenizer full(full_ss);
+    return full.AllTokens().first.size();
+  };
+  // 每次插入一个字符再删掉，保持源代码不变
+  BENCHMARK(fmt::format("{} MB, insert and remove", input.size() >> 20)) {
+    tokens = tkz.Retokenize(std::move(tokens), middle, 0, "1").first;
+    tokens = tkz.Retokenize(std::move(tokens), middle, 1, "").first;
+    return tokens.size();
+  };
+}
@@ -0,0 +1,150 @@
+#include "catch2/catch.hpp"
+#include "instruction/instruction.h"
+#include "vm/frame.h"
+#include "vm/sink.hpp"
+#include "vm/vm.hpp"
+
+#include <climits>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace miniplc0;
+
+namespace {
+std::string readBack(std::FILE *f) {
+  std::string s;
+  std::rewind(f);
+  char buf[4096];
+  for (std::size_t n; (n = std::fread(buf, 1, sizeof(buf), f)) > 0;)
+    s.append(buf, n);
+  return s;
+}
+
+std::string format(std::int32_t value) {
+  char buf[16];
+  return std::string(buf, FormatInt32(value, buf));
+}
+}  // namespace
+
+TEST_CASE("The frame is the deepest stack or the largest index.") {
+  // var a = 1; var b = 2; print(a + b * a);
+  std::vector<Instruction> v = {{LIT, 1}, {LIT, 2}, {LOD, 0}, {LOD, 1},
+                                {LOD, 0}, {MUL, 0}, {ADD, 0}, {WRT, 0}};
+  auto frame = AnalyseFrame(v);
+  REQUIRE(frame.first.has_value());
+  REQUIRE(frame.first->max_depth == 5);
+  REQUIRE(frame.first->variables == 2);
+  REQUIRE(frame.first->Slots() == 5);
+  VM vm(v);
+  REQUIRE(vm.GetStackSize() == 5);
+  REQUIRE(vm.Run() == std::vector<std::int32_t>{3});
+
+  SECTION("an index beyond the stack enlarges the frame") {
+    v.emplace_back(LOD, 9);
+    REQUIRE(AnalyseFrame(v).first->Slots() == 10);
+  }
+  SECTION("an empty program needs no stack") {
+    REQUIRE(AnalyseFrame({}).first->Slots() == 0);
+    REQUIRE(VM({}).GetStackSize() == 0);
+  }
+}
+
+TEST_CASE("Programs that underflow are rejected at load time.") {
+  std::vector<Instruction> v = {{LIT, 1}, {LIT, 2}, {ADD, 0}, {ADD, 0}};
+  auto frame = AnalyseFrame(v);
+  REQUIRE_FALSE(frame.first.has_value());
+  REQUIRE(frame.second == std::optional<std::size_t>(3));
+  REQUIRE_THROWS_AS(VM(v), std::invalid_argument);
+
+  REQUIRE(AnalyseFrame({{WRT, 0}}).second == std::optional<std::size_t>(0));
+  REQUIRE(AnalyseFrame({{LIT, 0}, {STO, -1}}).second ==
+          std::optional<std::size_t>(1));
+  // ILL 之后的指令不会执行
+  REQUIRE(AnalyseFrame({{LIT, 0}, {ILL, 0}, {WRT, 0}, {WRT, 0}})
+              .first.has_value());
+}
+
+TEST_CASE("The verifier accepts only safe stack accesses.") {
+  REQUIRE_FALSE(Verify({}).has_value());
+  REQUIRE_FALSE(Verify({{LIT, 1}, {LIT, 2}, {LOD, 1}, {STO, 0}, {WRT, 0}})
+                    .has_value());
+  // 读取栈上还没有的位置
+  REQUIRE(Verify({{LIT, 1}, {LOD, 1}}) == std::optional<std::size_t>(1));
+  // 写入自己弹出的位置
+  REQUIRE(Verify({{LIT, 1}, {STO, 0}}) == std::optional<std::size_t>(1));
+  REQUIRE(Verify({{LIT, 1}, {ADD, 0}}) == std::optional<std::size_t>(1));
+  REQUIRE(Verify({{LIT, 1}, {Operation(42), 0}}) ==
+          std::optional<std::size_t>(1));
+}
+
+TEST_CASE("Unverified programs run on the checked engine.") {
+  // 读取一个从来没有写过的位置，得到的是初始的 0
+  std::vector<Instruction> v = {{LIT, 7}, {LOD, 3}, {WRT, 0}, {WRT, 0}};
+  VM vm(v);
+  REQUIRE_FALSE(vm.IsVerified());
+  REQUIRE(vm.Run() == std::vector<std::int32_t>{0, 7});
+  // 再运行一次结果相同
+  REQUIRE(vm.Run() == std::vector<std::int32_t>{0, 7});
+
+  std::vector<Instruction> w = {{LIT, 7}, {LIT, 0}, {DIV, 0}};
+  // 通过验证的程序仍然检查算术错误
+  VM trapping(w);
+  REQUIRE(trapping.IsVerified());
+  REQUIRE_THROWS_AS(trapping.Run(), std::out_of_range);
+}
+
+TEST_CASE("FormatInt32 is the same as std::to_string.") {
+  for (std::int32_t v : {0, 1, -1, 9, 10, 99, 100, -100, 12345, 1000000000,
+                         INT_MAX, INT_MIN, INT_MIN + 1})
+    REQUIRE(format(v) == std::to_string(v));
+  std::mt19937 rng(42);
+  for (int i = 0; i < 100000; i++) {
+    auto v = static_cast<std::int32_t>(rng());
+    REQUIRE(format(v) == std::to_string(v));
+  }
+}
+
+TEST_CASE("Sinks write every value as soon as the buffer is full.") {
+  std::FILE *f = std::tmpfile();
+  REQUIRE(f != nullptr);
+  std::string expected;
+
+  SECTION("decimal") {
+    {
+      // 很小的缓冲区，保证会发生多次 flush
+      DecimalSink sink(fileno(f), 16);
+      for (std::int32_t i = -500; i < 500; i++) {
+        sink.Write(i * 4099);
+        expected += std::to_string(i * 4099) + "\n";
+      }
+      REQUIRE(sink.Flush());
+      REQUIRE(sink.GetBytesWritten() == expected.size());
+    }
+    REQUIRE(readBack(f) == expected);
+  }
+  SECTION("binary") {
+    {
+      BinarySink sink(fileno(f), 16);
+      sink.Write(1);
+      sink.Write(-2);
+      sink.Write(0x12345678);
+    }
+    expected = std::string("\x01\0\0\0\xfe\xff\xff\xff\x78\x56\x34\x12", 12);
+    REQUIRE(readBack(f) == expected);
+  }
+  std::fclose(f);
+}
+
+TEST_CASE("The VM streams its output to the sink.") {
+  // print(1); print(2); print(1 / 0);
+  std::vector<Instruction> v = {{LIT, 1}, {WRT, 0}, {LIT, 2}, {WRT, 0},
+                                {LIT, 1}, {LIT, 0}, {DIV, 0}, {WRT, 0}};
+  CollectingSink sink;
+  VM vm(v);
+  REQUIRE_THROWS_AS(vm.Run(sink), std::out_of_range);
+  // 出错之前的输出已经交给了 sink
+  REQUIRE(sink.GetValues() == std::vector<std::int32_t>{1, 2});
+}
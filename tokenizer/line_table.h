@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace miniplc0 {
+
+// 所有的位置都是源代码中的字节偏移，只有在输出时才换算成行号和列号
+// 行表记录每一行第一个字符的偏移，换算时二分查找
+// 行号和列号从 0 开始
+class LineTable final {
+ private:
+  using uint64_t = std::uint64_t;
+  using int64_t = std::int64_t;
+  using uint32_t = std::uint32_t;
+
+ public:
+  LineTable() : _line_starts({}) {}
+
+  // 新的一行从 start 开始，start 必须是递增的
+  void AddLine(uint32_t start) { _line_starts.emplace_back(start); }
+  uint64_t LineCount() const { return _line_starts.size(); }
+  uint32_t GetLineStart(uint64_t line) const { return _line_starts[line]; }
+  // 只保留前 count 行，用于出错时撤销扫描过的行
+  void Truncate(uint64_t count) { _line_starts.resize(count); }
+
+  // 把 [first, last] 中的行首换成 starts，之后的行首都移动 delta
+  // 用于增量分析，starts 必须都在 first 之后，并且小于移动后的行首
+  void Replace(uint32_t first, uint32_t last,
+               const std::vector<uint32_t> &starts, int64_t delta) {
+    auto lo = std::lower_bound(_line_starts.begin(), _line_starts.end(), first);
+    auto hi = std::upper_bound(lo, _line_starts.end(), last);
+    for (auto it = hi; it != _line_starts.end(); ++it)
+      *it = static_cast<uint32_t>(*it + delta);
+    lo = _line_starts.erase(lo, hi);
+    _line_starts.insert(lo, starts.begin(), starts.end());
+  }
+
+  // 返回 <行号，列号>
+  std::pair<uint64_t, uint64_t> GetPos(uint32_t offset) const {
+    auto it =
+        std::upper_bound(_line_starts.begin(), _line_starts.end(), offset);
+    if (it == _line_starts.begin()) return std::make_pair(0, offset);
+    --it;
+    return std::make_pair(it - _line_starts.begin(), offset - *it);
+  }
+
+ private:
+  std::vector<uint32_t> _line_starts;
+};
+
+// 一个带偏移的对象和它换算出的 <行号，列号>，用于输出
+template <typename T>
+class Located final {
+ private:
+  using uint64_t = std::uint64_t;
+
+ public:
+  Located(const T &value, std::pair<uint64_t, uint64_t> pos)
+      : _value(value), _pos(pos) {}
+
+  const T &Get() const { return _value; }
+  std::pair<uint64_t, uint64_t> GetPos() const { return _pos; }
+
+ private:
+  const T &_value;
+  std::pair<uint64_t, uint64_t> _pos;
+};
+}  // namespace miniplc0
@@ -3,6 +3,7 @@
 #include <any>
 #include <cstdint>
 #include <string>
+#include <string_view>
 
 #include "error/error.h"
 
@@ -27,31 +28,30 @@ enum TokenType {
   RIGHT_BRACKET
 };
 
+// 位置是源代码中的字节偏移，[start, end)
+// 需要行号和列号时通过 Tokenizer 的行表换算
+// 值可以是 std::string、char、int32_t，或者以 \0 结尾的 const char *
+// Tokenizer 产生的字符串都是 const char *，指向 Arena 中的副本
+// 这样复制 Token 时 std::any 不需要分配内存
 class Token final {
  private:
-  using uint64_t = std::uint64_t;
+  using uint32_t = std::uint32_t;
   using int32_t = std::int32_t;
+  using int64_t = std::int64_t;
 
  public:
   friend void swap(Token &lhs, Token &rhs);
 
  public:
-  Token(TokenType type, std::any value, uint64_t start_line,
-        uint64_t start_column, uint64_t end_line, uint64_t end_column)
-      : _type(type),
-        _value(std::move(value)),
-        _start_pos(start_line, start_column),
-        _end_pos(end_line, end_column) {}
-  Token(TokenType type, std::any value, std::pair<uint64_t, uint64_t> start,
-        std::pair<uint64_t, uint64_t> end)
-      : Token(type, value, start.first, start.second, end.first, end.second) {}
+  Token(TokenType type, std::any value, uint32_t start, uint32_t end)
+      : _type(type), _value(std::move(value)), _start(start), _end(end) {}
   Token(const Token &t) {
     _type = t._type;
     _value = t._value;
-    _start_pos = t._start_pos;
-    _end_pos = t._end_pos;
+    _start = t._start;
+    _end = t._end;
   }
-  Token(Token &&t) : Token(TokenType::NULL_TOKEN, nullptr, 0, 0, 0, 0) {
+  Token(Token &&t) : Token(TokenType::NULL_TOKEN, nullptr, 0, 0) {
     swap(*this, t);
   }
   Token &operator=(Token t) {
@@ -60,42 +60,44 @@ class Token final {
   }
   bool operator==(const Token &rhs) const {
     return _type == rhs._type && GetValueString() == rhs.GetValueString() &&
-           _start_pos == rhs._start_pos && _end_pos == rhs._end_pos;
+           _start == rhs._start && _end == rhs._end;
+  }
+
+  // 增量分析时，编辑之后的 token 整体移动
+  void Shift(int64_t delta) {
+    _start = static_cast<uint32_t>(_start + delta);
+    _end = static_cast<uint32_t>(_end + delta);
   }
 
   TokenType GetType() const { return _type; };
   std::any GetValue() const { return _value; };
-  std::pair<uint64_t, uint64_t> GetStartPos() const { return _start_pos; }
-  std::pair<uint64_t, uint64_t> GetEndPos() const { return _end_pos; }
+  uint32_t GetStartOffset() const { return _start; }
+  uint32_t GetEndOffset() const { return _end; }
   std::string GetValueString() const {
-    try {
-      return std::any_cast<std::string>(_value);
-    } catch (const std::bad_any_cast &) {
-    }
-    try {
-      return std::string(1, std::any_cast<char>(_value));
-    } catch (const std::bad_any_cast &) {
-    }
-    try {
-      return std::to_string(std::any_cast<int32_t>(_value));
-    } catch (const std::bad_any_cast &) {
-      DieAndPrint("No suitable cast for token value.");
-    }
+    if (auto p = std::any_cast<int32_t>(&_value)) return std::to_string(*p);
+    return std::string(GetValueView());
+  }
+  // 不复制字符串，只能用于字符串和字符，在 Token 销毁前有效
+  std::string_view GetValueView() const {
+    if (auto p = std::any_cast<const char *>(&_value)) return *p;
+    if (auto p = std::any_cast<std::string>(&_value)) return *p;
+    if (auto p = std::any_cast<char>(&_value)) return std::string_view(p, 1);
+    DieAndPrint("No suitable cast for token value.");
     return "Invalid";
   }
 
  private:
   TokenType _type;
   std::any _value;
-  std::pair<uint64_t, uint64_t> _start_pos;
-  std::pair<uint64_t, uint64_t> _end_pos;
+  uint32_t _start;
+  uint32_t _end;
 };
 
 inline void swap(Token &lhs, Token &rhs) {
   using std::swap;
   swap(lhs._type, rhs._type);
   swap(lhs._value, rhs._value);
-  swap(lhs._start_pos, rhs._start_pos);
-  swap(lhs._end_pos, rhs._end_pos);
+  swap(lhs._start, rhs._start);
+  swap(lhs._end, rhs._end);
 }
 }  // namespace miniplc0
@@ -1,7 +1,12 @@
 #include "tokenizer/tokenizer.h"
 
+#include <algorithm>
 #include <cctype>
-#include <sstream>
+#include <cstdint>
+#include <iterator>
+#include <thread>
+
+#include "stats/timer.h"
 
 namespace miniplc0 {
 
@@ -11,11 +16,11 @@ Tokenizer::NextToken() {
   if (_rdr.bad())
     return std::make_pair(
         std::optional<Token>(),
-        std::make_optional<CompilationError>(0, 0, ErrorCode::ErrStreamError));
+        std::make_optional<CompilationError>(0, ErrorCode::ErrStreamError));
   if (isEOF())
     return std::make_pair(
         std::optional<Token>(),
-        std::make_optional<CompilationError>(0, 0, ErrorCode::ErrEOF));
+        std::make_optional<CompilationError>(0, ErrorCode::ErrEOF));
   auto p = nextToken();
   if (p.second.has_value()) return std::make_pair(p.first, p.second);
   auto err = checkToken(p.first.value());
@@ -38,15 +43,228 @@ Tokenizer::AllTokens() {
   }
 }
 
+std::pair<std::vector<Token>, std::vector<CompilationError>>
+Tokenizer::AllTokensWithRecovery(std::size_t max_errors) {
+  std::vector<Token> result;
+  std::vector<CompilationError> errors;
+  while (true) {
+    auto p = NextToken();
+    if (!p.second.has_value()) {
+      result.emplace_back(p.first.value());
+      continue;
+    }
+    auto err = p.second.value();
+    if (err.GetCode() == ErrorCode::ErrEOF) break;
+    errors.emplace_back(err);
+    if (err.GetCode() == ErrorCode::ErrStreamError ||
+        errors.size() >= max_errors)
+      break;
+    if (p.first.has_value()) {
+      // 非法的标识符，token 本身是完整的
+      result.emplace_back(p.first.value());
+    } else if (err.GetCode() == ErrorCode::ErrInvalidInput) {
+      // 严格模式会回退这个字符，这里把它读走并用 NULL_TOKEN 占位
+      auto ch = nextChar().value();
+      result.emplace_back(TokenType::NULL_TOKEN, ch, err.GetOffset(),
+                          currentPos());
+    } else {
+      // 溢出的整数，同样用 NULL_TOKEN 占位
+      auto start = err.GetOffset();
+      auto end = currentPos();
+      result.emplace_back(
+          TokenType::NULL_TOKEN,
+          intern(std::string_view(_begin + start, end - start)), start, end);
+    }
+  }
+  return std::make_pair(std::move(result), std::move(errors));
+}
+
+Tokenizer::Tokenizer(const Tokenizer &parent, const char *begin,
+                     const char *end)
+    : _rdr(parent._rdr),
+      _initialized(true),
+      _buffer(),
+      _begin(parent._begin),
+      _end(end),
+      _ptr(begin),
+      _lines(),
+      _own_arena(new Arena()),
+      _arena(_own_arena.get()),
+      _names(_arena) {
+  // 第一项只是为了 nextChar() 判断是否已经记录过这一行，拼接时要去掉
+  _lines.AddLine(currentPos());
+}
+
+std::vector<const char *> Tokenizer::splitPoints(
+    std::size_t chunks, std::size_t min_chunk_size) const {
+  std::vector<const char *> result = {_ptr};
+  auto size = static_cast<std::size_t>(_end - _ptr);
+  auto step = std::max(size / std::max<std::size_t>(chunks, 1),
+                       std::max<std::size_t>(min_chunk_size, 1));
+  auto p = _ptr;
+  while (static_cast<std::size_t>(_end - p) > step) {
+    p += step;
+    // 前一个字符是空白才能切开，但是不能把 \r\n 拆成两个换行
+    while (p < _end &&
+           !(miniplc0::isspace(p[-1]) && !(p[-1] == '\r' && p[0] == '\n')))
+      p++;
+    if (p >= _end) break;
+    result.emplace_back(p);
+  }
+  result.emplace_back(_end);
+  return result;
+}
+
+std::pair<std::vector<Token>, std::optional<CompilationError>>
+Tokenizer::AllTokensParallel(std::size_t threads, std::size_t min_chunk_size) {
+  if (!_initialized) readAll();
+  if (_rdr.bad())
+    return std::make_pair(
+        std::vector<Token>(),
+        std::make_optional<CompilationError>(0, ErrorCode::ErrStreamError));
+  auto cuts = splitPoints(threads, min_chunk_size);
+  auto chunks = cuts.size() - 1;
+  if (chunks <= 1) {
+    // AllTokens() 出错时已经读走了一部分，要恢复指针和行表
+    auto ptr = _ptr;
+    auto lines = _lines.LineCount();
+    auto result = AllTokens();
+    if (result.second.has_value()) {
+      _ptr = ptr;
+      _lines.Truncate(lines);
+    }
+    return result;
+  }
+
+  std::vector<std::unique_ptr<Tokenizer>> workers;
+  std::vector<std::pair<std::vector<Token>, std::optional<CompilationError>>>
+      results(chunks);
+  std::vector<std::thread> pool;
+  for (std::size_t i = 0; i < chunks; i++)
+    workers.emplace_back(new Tokenizer(*this, cuts[i], cuts[i + 1]));
+  for (std::size_t i = 0; i < chunks; i++)
+    pool.emplace_back([&, i]() { results[i] = workers[i]->AllTokens(); });
+  for (auto &it : pool) it.join();
+
+  // 第一个出错的块里的错误就是串行分析时遇到的第一个错误
+  // 此时什么都不合并，各块的字符串随着各块的 arena 一起释放
+  for (auto &it : results)
+    if (it.second.has_value())
+      return std::make_pair(std::vector<Token>(), it.second);
+
+  // 行表是各块行表的拼接，各块的字符串都交给自己的 arena
+  for (auto &it : workers) {
+    for (uint64_t i = 1; i < it->_lines.LineCount(); i++)
+      _lines.AddLine(it->_lines.GetLineStart(i));
+    _arena->Adopt(*it->_arena);
+    _names.insert(it->_names.begin(), it->_names.end());
+  }
+
+  std::size_t total = 0;
+  for (auto &it : results) total += it.first.size();
+  std::vector<Token> tokens;
+  tokens.reserve(total);
+  for (auto &it : results)
+    std::move(it.first.begin(), it.first.end(), std::back_inserter(tokens));
+  _ptr = _end;
+  return std::make_pair(std::move(tokens), std::optional<CompilationError>());
+}
+
+std::pair<std::vector<Token>, std::optional<CompilationError>>
+Tokenizer::Retokenize(std::vector<Token> old, uint32_t offset,
+                      uint32_t removed, const std::string &inserted,
+                      std::pair<std::size_t, std::size_t> *relexed_range) {
+  if (!_initialized) readAll();
+  if (_rdr.bad())
+    return std::make_pair(
+        std::vector<Token>(),
+        std::make_optional<CompilationError>(0, ErrorCode::ErrStreamError));
+  if (offset > _buffer.size() || removed > _buffer.size() - offset)
+    DieAndPrint("edit out of range");
+  if (_buffer.size() - removed + inserted.size() > UINT32_MAX)
+    return std::make_pair(
+        std::vector<Token>(),
+        std::make_optional<CompilationError>(0, ErrorCode::ErrStreamError));
+
+  _buffer.replace(offset, removed, inserted);
+  _begin = _buffer.c_str();
+  _end = _begin + _buffer.size();
+  // 没有旧的 token 时从头分析，扫描时会重新记录所有的行首
+  // 旧的行表可能没有扫描完，不能只更新编辑的部分
+  if (old.empty())
+    _lines.Truncate(1);
+  else
+    updateLines(offset, removed, static_cast<uint32_t>(inserted.size()));
+  auto delta = static_cast<int64_t>(inserted.size()) - removed;
+  auto edit_end = static_cast<uint32_t>(offset + inserted.size());
+
+  // 在编辑位置之前结束的 token 不受影响，因为决定它结束的那个字符没有变
+  auto first = std::partition_point(
+      old.begin(), old.end(),
+      [offset](const Token &t) { return t.GetEndOffset() < offset; });
+  // 编辑位置之后的 token，编辑之后它们的位置都要加上 delta
+  auto rest = std::partition_point(first, old.end(), [&](const Token &t) {
+    return t.GetStartOffset() < offset + removed;
+  });
+  // 从一个 token 的末尾开始，自动机一定处于初始状态
+  _ptr = _begin + (first == old.begin() ? 0 : (first - 1)->GetEndOffset());
+  std::vector<Token> relexed;
+  while (true) {
+    auto p = NextToken();
+    if (p.second.has_value()) {
+      if (p.second.value().GetCode() != ErrorCode::ErrEOF)
+        return std::make_pair(std::vector<Token>(), p.second);
+      rest = old.end();
+      break;
+    }
+    auto &tk = p.first.value();
+    // 越过编辑的区域之后，只要新的 token 和旧的 token 从同一个位置开始
+    // 之后的源代码完全相同，所以之后的 token 也完全相同
+    if (tk.GetStartOffset() >= edit_end) {
+      auto start = tk.GetStartOffset() - delta;
+      while (rest != old.end() && rest->GetStartOffset() < start) ++rest;
+      if (rest != old.end() && rest->GetStartOffset() == start) break;
+    }
+    relexed.emplace_back(std::move(tk));
+  }
+  _ptr = _end;
+  if (relexed_range != nullptr) {
+    auto begin = static_cast<std::size_t>(first - old.begin());
+    *relexed_range = std::make_pair(begin, begin + relexed.size());
+  }
+  // 直接在 old 上修改，前面的 token 原样保留，后面的只修正偏移
+  for (auto it = rest; it != old.end(); ++it) it->Shift(delta);
+  auto common = std::min<std::ptrdiff_t>(rest - first, relexed.size());
+  std::move(relexed.begin(), relexed.begin() + common, first);
+  first += common;
+  if (first != rest)
+    old.erase(first, rest);
+  else
+    old.insert(first, std::make_move_iterator(relexed.begin() + common),
+               std::make_move_iterator(relexed.end()));
+  return std::make_pair(std::move(old), std::optional<CompilationError>());
+}
+
+void Tokenizer::updateLines(uint32_t offset, uint32_t removed,
+                            uint32_t inserted) {
+  // s 是行首当且仅当 s - 1 是 \n，或者 s - 1 是一个后面不是 \n 的 \r
+  // 所以只有 [offset, offset + inserted] 中的行首可能改变
+  std::vector<uint32_t> starts;
+  auto last = std::min<std::size_t>(offset + inserted, _buffer.size());
+  for (std::size_t s = std::max<uint32_t>(offset, 1); s <= last; s++)
+    if (_begin[s - 1] == '\n' || (_begin[s - 1] == '\r' && _begin[s] != '\n'))
+      starts.emplace_back(static_cast<uint32_t>(s));
+  _lines.Replace(std::max<uint32_t>(offset, 1), offset + removed, starts,
+                 static_cast<int64_t>(inserted) - removed);
+}
+
 // 注意：这里的返回值中 Token 和 CompilationError 只能返回一个，不能同时返回。
 std::pair<std::optional<Token>, std::optional<CompilationError>>
 Tokenizer::nextToken() {
-  // 用于存储已经读到的组成当前token字符
-  std::stringstream ss;
   // 分析token的结果，作为此函数的返回值
   std::pair<std::optional<Token>, std::optional<CompilationError>> result;
-  // <行号，列号>，表示当前token的第一个字符在源代码中的位置
-  std::pair<int64_t, int64_t> pos;
+  // 偏移，表示当前token的第一个字符在源代码中的位置
+  uint32_t pos = 0;
   // 记录当前自动机的状态，进入此函数时是初始状态
   DFAState current_state = DFAState::INITIAL_STATE;
   // 这是一个死循环，除非主动跳出
@@ -68,7 +286,7 @@ Tokenizer::nextToken() {
           // 返回一个空的token，和编译错误ErrEOF：遇到了文件尾
           return std::make_pair(
               std::optional<Token>(),
-              std::make_optional<CompilationError>(0, 0, ErrEOF));
+              std::make_optional<CompilationError>(0, ErrEOF));
 
         // 获取读到的字符的值，注意auto推导出的类型是char
         auto ch = current_char.value();
@@ -94,17 +312,26 @@ Tokenizer::nextToken() {
               current_state = DFAState::EQUAL_SIGN_STATE;
               break;
             case '-':
-              // 请填空：切换到减号的状态
+              current_state = DFAState::MINUS_SIGN_STATE;
+              break;
             case '+':
-              // 请填空：切换到加号的状态
+              current_state = DFAState::PLUS_SIGN_STATE;
+              break;
             case '*':
-              // 请填空：切换状态
+              current_state = DFAState::MULTIPLICATION_SIGN_STATE;
+              break;
             case '/':
-              // 请填空：切换状态
-
-            ///// 请填空：
-            ///// 对于其他的可接受字符
-            ///// 切换到对应的状态
+              current_state = DFAState::DIVISION_SIGN_STATE;
+              break;
+            case ';':
+              current_state = DFAState::SEMICOLON_STATE;
+              break;
+            case '(':
+              current_state = DFAState::LEFTBRACKET_STATE;
+              break;
+            case ')':
+              current_state = DFAState::RIGHTBRACKET_STATE;
+              break;
 
             // 不接受的字符导致的不合法的状态
             default:
@@ -117,37 +344,68 @@ Tokenizer::nextToken() {
           pos = previousPos();  // 记录该字符的的位置为token的开始位置
         // 读到了不合法的字符
         if (invalid) {
-          // 回退这个字符
+          // 回退这个字符，错误的位置就是这个字符的位置
           unreadLast();
+          pos = currentPos();
           // 返回编译错误：非法的输入
           return std::make_pair(std::optional<Token>(),
                                 std::make_optional<CompilationError>(
                                     pos, ErrorCode::ErrInvalidInput));
         }
-        // 如果读到的字符导致了状态的转移，说明它是一个token的第一个字符
-        if (current_state != DFAState::INITIAL_STATE)  // ignore white spaces
-          ss << ch;                                    // 存储读到的字符
+        // token 中不会有换行，所以组成 token 的字符就是缓冲区中连续的一段
+        // 不需要单独存储，token 结束时从 pos 开始取出即可
         break;
       }
 
         // 当前状态是无符号整数
       case UNSIGNED_INTEGER_STATE: {
-        // 请填空：
-        // 如果当前已经读到了文件尾，则解析已经读到的字符串为整数
-        //     解析成功则返回无符号整数类型的token，否则返回编译错误
-        // 如果读到的字符是数字，则存储读到的字符
-        // 如果读到的字符不是数字，则回退读到的字符，并解析已经读到的字符串为整数
-        //     解析成功则返回无符号整数类型的token，否则返回编译错误
-        break;
+        // 如果读到的字符是数字，则继续读
+        if (current_char.has_value() &&
+            miniplc0::isdigit(current_char.value()))
+          break;
+        // 数字后面紧跟字母，按标识符处理，checkToken 会报告非法的标识符
+        if (current_char.has_value() &&
+            miniplc0::isalpha(current_char.value())) {
+          current_state = DFAState::IDENTIFIER_STATE;
+          break;
+        }
+        // 如果读到的字符不是数字，则回退读到的字符，文件尾也一样
+        unreadLast();
+        // 解析已经读到的字符串为整数，解析成功则返回无符号整数类型的token
+        auto val = parseUnsignedInteger(
+            std::string_view(_begin + pos, currentPos() - pos));
+        if (!val.has_value())
+          return std::make_pair(std::optional<Token>(),
+                                std::make_optional<CompilationError>(
+                                    pos, ErrorCode::ErrIntegerOverflow));
+        return std::make_pair(
+            std::make_optional<Token>(TokenType::UNSIGNED_INTEGER, val.value(),
+                                      pos, currentPos()),
+            std::optional<CompilationError>());
       }
       case IDENTIFIER_STATE: {
-        // 请填空：
-        // 如果当前已经读到了文件尾，则解析已经读到的字符串
-        //     如果解析结果是关键字，那么返回对应关键字的token，否则返回标识符的token
-        // 如果读到的是字符或字母，则存储读到的字符
-        // 如果读到的字符不是上述情况之一，则回退读到的字符，并解析已经读到的字符串
-        //     如果解析结果是关键字，那么返回对应关键字的token，否则返回标识符的token
-        break;
+        // 如果读到的是字符或字母，则继续读
+        if (current_char.has_value() &&
+            (miniplc0::isalpha(current_char.value()) ||
+             miniplc0::isdigit(current_char.value())))
+          break;
+        unreadLast();
+        // 如果解析结果是关键字，那么返回对应关键字的token，否则返回标识符的token
+        auto str = std::string_view(_begin + pos, currentPos() - pos);
+        auto type = TokenType::IDENTIFIER;
+        if (str == "begin")
+          type = TokenType::BEGIN;
+        else if (str == "end")
+          type = TokenType::END;
+        else if (str == "var")
+          type = TokenType::VAR;
+        else if (str == "const")
+          type = TokenType::CONST;
+        else if (str == "print")
+          type = TokenType::PRINT;
+        return std::make_pair(
+            std::make_optional<Token>(type, intern(str), pos, currentPos()),
+            std::optional<CompilationError>());
       }
 
         // 如果当前状态是加号
@@ -160,12 +418,51 @@ Tokenizer::nextToken() {
       }
         // 当前状态为减号的状态
       case MINUS_SIGN_STATE: {
-        // 请填空：回退，并返回减号token
+        unreadLast();
+        return std::make_pair(std::make_optional<Token>(TokenType::MINUS_SIGN,
+                                                        '-', pos, currentPos()),
+                              std::optional<CompilationError>());
+      }
+      case MULTIPLICATION_SIGN_STATE: {
+        unreadLast();
+        return std::make_pair(
+            std::make_optional<Token>(TokenType::MULTIPLICATION_SIGN, '*', pos,
+                                      currentPos()),
+            std::optional<CompilationError>());
+      }
+      case DIVISION_SIGN_STATE: {
+        unreadLast();
+        return std::make_pair(
+            std::make_optional<Token>(TokenType::DIVISION_SIGN, '/', pos,
+                                      currentPos()),
+            std::optional<CompilationError>());
+      }
+      case EQUAL_SIGN_STATE: {
+        unreadLast();
+        return std::make_pair(std::make_optional<Token>(TokenType::EQUAL_SIGN,
+                                                        '=', pos, currentPos()),
+                              std::optional<CompilationError>());
+      }
+      case SEMICOLON_STATE: {
+        unreadLast();
+        return std::make_pair(std::make_optional<Token>(TokenType::SEMICOLON,
+                                                        ';', pos, currentPos()),
+                              std::optional<CompilationError>());
+      }
+      case LEFTBRACKET_STATE: {
+        unreadLast();
+        return std::make_pair(
+            std::make_optional<Token>(TokenType::LEFT_BRACKET, '(', pos,
+                                      currentPos()),
+            std::optional<CompilationError>());
+      }
+      case RIGHTBRACKET_STATE: {
+        unreadLast();
+        return std::make_pair(
+            std::make_optional<Token>(TokenType::RIGHT_BRACKET, ')', pos,
+                                      currentPos()),
+            std::optional<CompilationError>());
       }
-
-        // 请填空：
-        // 对于其他的合法状态，进行合适的操作
-        // 比如进行解析、返回token、返回编译错误
 
         // 预料之外的状态，如果执行到了这里，说明程序异常
       default:
@@ -181,11 +478,10 @@ Tokenizer::nextToken() {
 std::optional<CompilationError> Tokenizer::checkToken(const Token& t) {
   switch (t.GetType()) {
     case IDENTIFIER: {
-      auto val = t.GetValueString();
+      auto val = t.GetValueView();
       if (miniplc0::isdigit(val[0]))
         return std::make_optional<CompilationError>(
-            t.GetStartPos().first, t.GetStartPos().second,
-            ErrorCode::ErrInvalidIdentifier);
+            t.GetStartOffset(), ErrorCode::ErrInvalidIdentifier);
       break;
     }
     default:
@@ -194,46 +490,82 @@ std::optional<CompilationError> Tokenizer::checkToken(const Token& t) {
   return {};
 }
 
+const char *Tokenizer::intern(std::string_view s) {
+  auto it = _names.find(s);
+  if (it != _names.end()) return it->data();
+  auto p = _arena->CopyString(s);
+  _names.emplace(p, s.size());
+  return p;
+}
+
+std::optional<int32_t> Tokenizer::parseUnsignedInteger(std::string_view s) {
+  int64_t val = 0;
+  for (auto ch : s) {
+    val = val * 10 + (ch - '0');
+    if (val > INT32_MAX) return {};
+  }
+  return static_cast<int32_t>(val);
+}
+
+std::string_view Tokenizer::GetLine(uint64_t line) const {
+  if (line >= _lines.LineCount()) return {};
+  auto start = _lines.GetLineStart(line);
+  auto end = _buffer.find_first_of("\r\n", start);
+  if (end == std::string::npos) end = _buffer.size();
+  return std::string_view(_buffer).substr(start, end - start);
+}
+
 void Tokenizer::readAll() {
   if (_initialized) return;
-  for (std::string tp; std::getline(_rdr, tp);)
-    _lines_buffer.emplace_back(std::move(tp + "\n"));
+  MINIPLC0_TIME_SCOPE("read input");
+  char chunk[1 << 16];
+  while (_rdr.read(chunk, sizeof(chunk)) || _rdr.gcount() > 0) {
+    _buffer.append(chunk, static_cast<std::size_t>(_rdr.gcount()));
+    // 偏移只有 32 位
+    if (_buffer.size() > UINT32_MAX) {
+      _rdr.setstate(std::ios::badbit);
+      break;
+    }
+  }
   _initialized = true;
-  _ptr = std::make_pair<int64_t, int64_t>(0, 0);
+  _begin = _buffer.c_str();
+  _end = _begin + _buffer.size();
+  _ptr = _begin;
+  _lines.AddLine(0);
   return;
 }
 
-// Note: We allow this function to return a postion which is out of bound
-// according to the design like std::vector::end().
-std::pair<uint64_t, uint64_t> Tokenizer::nextPos() {
-  if (_ptr.first >= _lines_buffer.size()) DieAndPrint("advance after EOF");
-  if (_ptr.second == _lines_buffer[_ptr.first].size() - 1)
-    return std::make_pair(_ptr.first + 1, 0);
-  else
-    return std::make_pair(_ptr.first, _ptr.second + 1);
+uint32_t Tokenizer::currentPos() {
+  return static_cast<uint32_t>(_ptr - _begin);
 }
 
-std::pair<uint64_t, uint64_t> Tokenizer::currentPos() { return _ptr; }
-
-std::pair<uint64_t, uint64_t> Tokenizer::previousPos() {
-  if (_ptr.first == 0 && _ptr.second == 0)
-    DieAndPrint("previous position from beginning");
-  if (_ptr.second == 0)
-    return std::make_pair(_ptr.first - 1,
-                          _lines_buffer[_ptr.first - 1].size() - 1);
-  else
-    return std::make_pair(_ptr.first, _ptr.second - 1);
+// 注意 \r\n 是一个字符
+uint32_t Tokenizer::previousPos() {
+  if (_ptr == _begin) DieAndPrint("previous position from beginning");
+  auto prev = _ptr - 1;
+  if (*prev == '\n' && prev > _begin && prev[-1] == '\r') prev--;
+  return static_cast<uint32_t>(prev - _begin);
 }
 
 std::optional<char> Tokenizer::nextChar() {
-  if (isEOF()) return {};  // EOF
-  auto result = _lines_buffer[_ptr.first][_ptr.second];
-  _ptr = nextPos();
-  return result;
+  auto ch = *_ptr++;
+  // 哨兵，越过它是为了让 unreadLast() 总是成立
+  if (_ptr > _end) return {};
+  if (ch == '\r') {
+    if (*_ptr == '\n') _ptr++;
+    ch = '\n';
+  }
+  if (ch == '\n') {
+    // 回退之后会再读一次同一个换行
+    auto start = currentPos();
+    if (start > _lines.GetLineStart(_lines.LineCount() - 1))
+      _lines.AddLine(start);
+  }
+  return ch;
 }
 
-bool Tokenizer::isEOF() { return _ptr.first >= _lines_buffer.size(); }
+bool Tokenizer::isEOF() { return _ptr >= _end; }
 
 // Note: Is it evil to unread a buffer?
-void Tokenizer::unreadLast() { _ptr = previousPos(); }
+void Tokenizer::unreadLast() { _ptr = _begin + previousPos(); }
 }  // namespace miniplc0
@@ -1,14 +1,20 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <iostream>
 #include <memory>
+#include <memory_resource>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
 #include "error/error.h"
+#include "memory/arena.h"
+#include "tokenizer/line_table.h"
 #include "tokenizer/token.h"
 #include "tokenizer/utils.hpp"
 
@@ -17,6 +23,8 @@ namespace miniplc0 {
 class Tokenizer final {
  private:
   using uint64_t = std::uint64_t;
+  using uint32_t = std::uint32_t;
+  using int32_t = std::int32_t;
 
   // 状态机的所有状态
   enum DFAState {
@@ -34,8 +42,25 @@ class Tokenizer final {
   };
 
  public:
-  Tokenizer(std::istream &ifs)
-      : _rdr(ifs), _initialized(false), _ptr(0, 0), _lines_buffer() {}
+  // 一次最多收集的错误个数
+  static constexpr std::size_t kMaxErrors = 100;
+  // 并行分析时每一块至少这么大，太小的块不值得开一个线程
+  static constexpr std::size_t kMinChunkSize = 1 << 20;
+
+ public:
+  // 标识符的字符串分配在 arena 中，token 不能比 arena 活得更久
+  // 没有 arena 时使用自己的，此时 token 不能比 Tokenizer 活得更久
+  Tokenizer(std::istream &ifs, Arena *arena = nullptr)
+      : _rdr(ifs),
+        _initialized(false),
+        _buffer(),
+        _begin(nullptr),
+        _end(nullptr),
+        _ptr(nullptr),
+        _lines(),
+        _own_arena(arena == nullptr ? new Arena() : nullptr),
+        _arena(arena == nullptr ? _own_arena.get() : arena),
+        _names(_arena) {}
   Tokenizer(Tokenizer &&tkz) = delete;
   Tokenizer(const Tokenizer &) = delete;
   Tokenizer &operator=(const Tokenizer &) = delete;
@@ -44,40 +69,93 @@ class Tokenizer final {
   std::pair<std::optional<Token>, std::optional<CompilationError>> NextToken();
   // 一次返回所有 token
   std::pair<std::vector<Token>, std::optional<CompilationError>> AllTokens();
+  // 遇到词法错误后继续分析，最多收集 max_errors 个错误
+  // 非法字符和溢出的整数会变成一个 NULL_TOKEN，非法的标识符仍然是标识符
+  // 错误的位置和 AllTokens() 完全一致
+  std::pair<std::vector<Token>, std::vector<CompilationError>>
+  AllTokensWithRecovery(std::size_t max_errors = kMaxErrors);
+  // 把剩下的输入在空白处切成若干块，用 threads 个线程分别分析再拼起来
+  // miniplc0 的 token 里不会出现空白，所以任何空白字符后面都可以切开
+  // 结果和 AllTokens() 完全一致
+  // 出错时指针和行表都不会改变，可以再调用 AllTokensWithRecovery() 找出所有错误
+  std::pair<std::vector<Token>, std::optional<CompilationError>>
+  AllTokensParallel(std::size_t threads,
+                    std::size_t min_chunk_size = kMinChunkSize);
+  // 增量分析：把源代码的 [offset, offset + removed) 替换成 inserted
+  // old 必须是编辑之前整个源代码的 token，可以为空，此时会重新分析全部内容
+  // 只从编辑位置之前的最后一个 token 边界开始重新分析，直到和 old 重新同步
+  // 之后的 token 直接复用，只修正偏移
+  // 结果和对编辑之后的源代码调用 AllTokens() 完全一致
+  // 如果 relexed 不为空，返回重新分析得到的 token 的下标范围 [first, last)
+  // 其余的 token 和 old 中的相同，只是偏移不同，见 Analyser::Reanalyse()
+  std::pair<std::vector<Token>, std::optional<CompilationError>> Retokenize(
+      std::vector<Token> old, uint32_t offset, uint32_t removed,
+      const std::string &inserted,
+      std::pair<std::size_t, std::size_t> *relexed = nullptr);
+
+  // 读入的源代码的字节数，还没有开始分析时是 0
+  uint64_t GetInputSize() const { return _buffer.size(); }
+
+  // 下面的函数只用于输出，所以不必太在意效率
+
+  // 把偏移换算成 <行号，列号>
+  std::pair<uint64_t, uint64_t> GetPos(uint32_t offset) const {
+    return _lines.GetPos(offset);
+  }
+  // 返回第 line 行的源代码，不包括换行，行号超出范围时返回空串
+  // 只有已经扫描过的行才能找到
+  std::string_view GetLine(uint64_t line) const;
+  // 输出 token 时需要它的起始位置
+  Located<Token> Locate(const Token &t) const {
+    return Located<Token>(t, GetPos(t.GetStartOffset()));
+  }
+  // 输出错误时需要它的位置和所在的那一行
+  Diagnostic GetDiagnostic(const CompilationError &err) const {
+    auto pos = GetPos(err.GetOffset());
+    return Diagnostic(err, pos, GetLine(pos.first));
+  }
 
  private:
   // 检查 Token 的合法性
   std::optional<CompilationError> checkToken(const Token &);
-  //
-  // ** 你需要完成这个函数 **
-  //
   // 返回下一个 token，是 NextToken 实际实现部分
   std::pair<std::optional<Token>, std::optional<CompilationError>> nextToken();
+  // 并行分析用的 Tokenizer，它只扫描 parent 的 [begin, end)
+  // 位置仍然是相对于整个缓冲区的偏移，所以拼接时 token 不需要修正
+  Tokenizer(const Tokenizer &parent, const char *begin, const char *end);
+  // 编辑之后重新计算 [offset, offset + inserted] 中的行首
+  void updateLines(uint32_t offset, uint32_t removed, uint32_t inserted);
+  // 并行分析时的切分点，包括开头和结尾
+  std::vector<const char *> splitPoints(std::size_t chunks,
+                                        std::size_t min_chunk_size) const;
+  // 把只包含数字的字符串解析为 int32_t，溢出时返回空
+  static std::optional<int32_t> parseUnsignedInteger(std::string_view);
+  // 返回 s 在 arena 中的副本，相同的字符串只复制一次
+  const char *intern(std::string_view s);
 
-  // 从这里开始其实是一个基于行号的缓冲区的实现
+  // 从这里开始其实是一个缓冲区的实现
   // 为了简单起见，我们没有单独拿出一个类实现
-  // 核心思想和 C 的文件输入输出类似，就是一个 buffer 加一个指针，有三个细节
-  // 1.缓冲区包括 \n
+  // 核心思想和 C 的文件输入输出类似，就是一个 buffer 加一个指针，有四个细节
+  // 1.缓冲区就是原始的输入，末尾有一个 \0 作为哨兵
   // 2.指针始终指向下一个要读取的 char
-  // 3.行号和列号从 0 开始
+  // 3.位置就是缓冲区中的偏移，行号和列号由行表换算
+  // 4.\r \n \r\n 都是换行，在 nextChar() 中统一成 \n，同时建立行表
 
-  // 一次读入全部内容，并且替换所有换行为 \n
-  // 这样其实是不合理的，这里只是简单起见这么实现
+  // 一次读入全部内容
   void readAll();
   // 一个简单的总结
-  // | 0 | 1 | 2 | 3 | 4 | 5 | 6 | 7 | 8 | 9  | 偏移
-  // | = | = | = | = | = | = | = | = | = | =  |
-  // | h | a | 1 | 9 | 2 | 6 | 0 | 8 | 1 | \n |（缓冲区第0行）
-  // | 7 | 1 | 1 | 4 | 5 | 1 | 4 |             （缓冲区第1行）
-  // 这里假设指针指向第一行的 \n，那么有
-  // nextPos() = (1, 0)
-  // currentPos() = (0, 9)
-  // previousPos() = (0, 8)
-  // nextChar() = '\n' 并且指针移动到 (1, 0)
-  // unreadLast() 指针移动到 (0, 8)
-  std::pair<uint64_t, uint64_t> nextPos();
-  std::pair<uint64_t, uint64_t> currentPos();
-  std::pair<uint64_t, uint64_t> previousPos();
+  // | 0 | 1 | 2 | 3 | 4 | 5 | 6 | 7 | 8 | 9  | 10 | 11 | 12 | 13 | 偏移
+  // | = | = | = | = | = | = | = | = | = | =  | =  | =  | =  | =  |
+  // | h | a | 1 | 9 | 2 | 6 | 0 | 8 | 1 | \r | \n | 7  | 1  | \0 |
+  // 读过第一个换行之后行表是 {0, 11}
+  // 这里假设指针指向第一行的 \r，那么有
+  // currentPos() = 9
+  // previousPos() = 8
+  // nextChar() = '\n' 并且指针移动到 11
+  // 然后 previousPos() = 9，unreadLast() 指针回到 9
+  // 读到哨兵时 nextChar() 返回空，指针仍然会移动，所以总是可以 unreadLast()
+  uint32_t currentPos();
+  uint32_t previousPos();
   std::optional<char> nextChar();
   bool isEOF();
   void unreadLast();
@@ -86,9 +164,18 @@ class Tokenizer final {
   std::istream &_rdr;
   // 如果没有初始化，那么就 readAll
   bool _initialized;
+  // 全部源代码，std::string 保证 _buffer[_buffer.size()] 是 \0
+  std::string _buffer;
+  // 第一个字符和末尾的哨兵
+  const char *_begin;
+  const char *_end;
   // 指向下一个要读取的字符
-  std::pair<uint64_t, uint64_t> _ptr;
-  // 以行为基础的缓冲区
-  std::vector<std::string> _lines_buffer;
+  const char *_ptr;
+  // 每一行在 _buffer 中的起始偏移，扫描到哪里就建立到哪里
+  LineTable _lines;
+  // token 中的字符串都在 _arena 中，_names 记录已经复制过的字符串
+  std::unique_ptr<Arena> _own_arena;
+  Arena *_arena;
+  std::pmr::unordered_set<std::string_view> _names;
 };
 }  // namespace miniplc0
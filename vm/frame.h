@@ -0,0 +1,115 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "instruction/instruction.h"
+
+namespace miniplc0 {
+
+// 一段指令运行时需要的栈
+// 变量和操作数在同一个栈上：声明按顺序把初始值压栈，之后用 LOD/STO 的下标访问
+// 指令没有跳转，所以扫描一遍就可以知道每条指令执行前栈的深度
+struct Frame {
+  // 操作数栈的最大深度，包括变量
+  std::uint64_t max_depth = 0;
+  // LOD 和 STO 用到的最大下标加一
+  std::uint64_t variables = 0;
+  // 需要分配的栈的大小
+  std::uint64_t Slots() const { return std::max(max_depth, variables); }
+};
+
+// 返回 <栈的大小，出错的指令的下标>
+// 某条指令弹出的值比栈上的多，或者 LOD/STO 的下标是负的时候出错，此时第一项为空
+inline std::pair<std::optional<Frame>, std::optional<std::size_t>>
+AnalyseFrame(const std::vector<Instruction> &v) {
+  Frame frame;
+  std::uint64_t depth = 0;
+  for (std::size_t i = 0; i < v.size(); i++) {
+    auto x = v[i].GetX();
+    // 弹出和压入的值的个数
+    std::uint64_t pop = 0, push = 0;
+    switch (v[i].GetOperation()) {
+      case Operation::LIT:
+        push = 1;
+        break;
+      case Operation::LOD:
+      case Operation::STO:
+        if (x < 0) return std::make_pair(std::nullopt, i);
+        frame.variables =
+            std::max(frame.variables, static_cast<std::uint64_t>(x) + 1);
+        pop = v[i].GetOperation() == Operation::STO;
+        push = v[i].GetOperation() == Operation::LOD;
+        break;
+      case Operation::ADD:
+      case Operation::SUB:
+      case Operation::MUL:
+      case Operation::DIV:
+        pop = 2;
+        push = 1;
+        break;
+      case Operation::WRT:
+        pop = 1;
+        break;
+      // 运行到这里时虚拟机会停止，之后的指令不会执行
+      case Operation::ILL:
+        return std::make_pair(frame, std::nullopt);
+    }
+    if (depth < pop) return std::make_pair(std::nullopt, i);
+    depth = depth - pop + push;
+    frame.max_depth = std::max(frame.max_depth, depth);
+  }
+  return std::make_pair(frame, std::nullopt);
+}
+
+// 验证一段指令，返回第一条不能通过验证的指令的下标，全部通过时为空
+// 通过验证的程序在运行时：
+// 1.栈不会下溢，深度不会超过 AnalyseFrame() 给出的大小
+// 2.LOD 读取的和 STO 写入的都是栈上已有的值，也就是一定被写过的位置
+//   STO 的下标不能是它自己弹出的那个位置
+// 3.只包含合法的操作
+// 所以虚拟机运行它时可以去掉每条指令的检查，见 VM::Run()
+// 编译器生成的指令总是能通过验证
+inline std::optional<std::size_t> Verify(const std::vector<Instruction> &v) {
+  std::uint64_t depth = 0;
+  for (std::size_t i = 0; i < v.size(); i++) {
+    auto x = static_cast<std::int64_t>(v[i].GetX());
+    auto ok = true;
+    switch (v[i].GetOperation()) {
+      // 和 AnalyseFrame() 一样，ILL 之后的指令不会执行
+      case Operation::ILL:
+        return {};
+      case Operation::LIT:
+        depth++;
+        break;
+      case Operation::LOD:
+        ok = x >= 0 && static_cast<std::uint64_t>(x) < depth;
+        depth++;
+        break;
+      case Operation::STO:
+        ok = depth >= 1 && x >= 0 && static_cast<std::uint64_t>(x) < depth - 1;
+        depth--;
+        break;
+      case Operation::ADD:
+      case Operation::SUB:
+      case Operation::MUL:
+      case Operation::DIV:
+        ok = depth >= 2;
+        depth--;
+        break;
+      case Operation::WRT:
+        ok = depth >= 1;
+        depth--;
+        break;
+      default:
+        ok = false;
+    }
+    if (!ok) return i;
+  }
+  return {};
+}
+}  // namespace miniplc0
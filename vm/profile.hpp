@@ -0,0 +1,189 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define MINIPLC0_HAS_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define MINIPLC0_HAS_RDTSC
+#endif
+
+#include "instruction/instruction.h"
+#include "instruction/source_map.h"
+
+namespace miniplc0 {
+
+// 构建时定义了 MINIPLC0_PROFILE_VM 时，VM::Run() 把每条指令报告给 VMProfile
+// 没有定义时 VM 中没有任何统计的代码
+#ifdef MINIPLC0_PROFILE_VM
+inline constexpr bool kProfileVM = true;
+#else
+inline constexpr bool kProfileVM = false;
+#endif
+
+// 虚拟机的执行统计：每种操作和每条指令执行的次数和用的时间
+// 以及相邻两条指令的操作的组合出现的次数，用来决定哪些指令值得合并
+// 时间的单位是 tick：x86 上是 rdtsc 的周期数，其他平台是纳秒
+// 一条指令的时间是从它开始到下一条指令开始，包括统计本身的开销
+// 多次运行的统计累加在一起
+class VMProfile final {
+ private:
+  using uint64_t = std::uint64_t;
+
+ public:
+  static constexpr std::size_t kOperationCount = WRT + 1;
+
+  struct Entry {
+    uint64_t count = 0;
+    uint64_t ticks = 0;
+  };
+  struct Pair {
+    Operation first;
+    Operation second;
+    uint64_t count;
+  };
+  // 一个语句的全部指令的统计
+  struct Source {
+    std::uint32_t offset;
+    Entry entry;
+  };
+
+ public:
+  VMProfile()
+      : _operations(), _instructions(), _pairs(), _last(kNone), _time(0) {
+    for (auto &it : _pairs) it.fill(0);
+  }
+
+  // 由 VM 调用：开始运行一个有 size 条指令的程序，依次执行每条指令，结束
+  // 运行时出错时不会调用 End()，最后一条指令的时间不统计
+  void Begin(std::size_t size) {
+    if (_instructions.size() < size) _instructions.resize(size);
+    _last = kNone;
+    _time = Now();
+  }
+  void Step(std::size_t index, Operation op) {
+    auto now = Now();
+    if (_last != kNone) {
+      record(now);
+      _pairs[_instructions[_last].op][op]++;
+    }
+    _last = index;
+    _instructions[index].op = op;
+    _time = now;
+  }
+  void End() {
+    if (_last != kNone) record(Now());
+    _last = kNone;
+  }
+
+  const Entry &GetOperation(Operation op) const { return _operations[op]; }
+  // 下标是指令的下标
+  Entry GetInstruction(std::size_t index) const {
+    return _instructions[index].entry;
+  }
+  std::size_t GetInstructionCount() const { return _instructions.size(); }
+  uint64_t GetPair(Operation first, Operation second) const {
+    return _pairs[first][second];
+  }
+
+  // 执行过的操作，按时间从多到少
+  std::vector<Operation> OperationsByTicks() const {
+    std::vector<Operation> v;
+    for (std::size_t i = 0; i < kOperationCount; i++)
+      if (_operations[i].count > 0) v.emplace_back(Operation(i));
+    std::stable_sort(v.begin(), v.end(), [this](Operation a, Operation b) {
+      return _operations[a].ticks > _operations[b].ticks;
+    });
+    return v;
+  }
+  // 时间最多的 n 条指令的下标，按时间从多到少
+  std::vector<std::size_t> HottestInstructions(std::size_t n) const {
+    std::vector<std::size_t> v(_instructions.size());
+    std::iota(v.begin(), v.end(), 0);
+    auto by_ticks = [this](std::size_t a, std::size_t b) {
+      return _instructions[a].entry.ticks > _instructions[b].entry.ticks;
+    };
+    n = std::min(n, v.size());
+    std::partial_sort(v.begin(), v.begin() + n, v.end(), by_ticks);
+    v.resize(n);
+    while (!v.empty() && _instructions[v.back()].entry.count == 0)
+      v.pop_back();
+    return v;
+  }
+  // 出现过的操作组合，按次数从多到少
+  std::vector<Pair> PairsByCount() const {
+    std::vector<Pair> v;
+    for (std::size_t i = 0; i < kOperationCount; i++)
+      for (std::size_t j = 0; j < kOperationCount; j++)
+        if (_pairs[i][j] > 0)
+          v.push_back({Operation(i), Operation(j), _pairs[i][j]});
+    std::stable_sort(v.begin(), v.end(), [](const Pair &a, const Pair &b) {
+      return a.count > b.count;
+    });
+    return v;
+  }
+
+  // 按 source_map 把指令的统计归到它们来自的语句，按指令的顺序
+  std::vector<Source> BySource(const SourceMap &source_map) const {
+    std::vector<Source> v;
+    auto &runs = source_map.GetRuns();
+    for (std::size_t r = 0; r < runs.size(); r++) {
+      auto last = r + 1 < runs.size() ? runs[r + 1].instruction
+                                      : _instructions.size();
+      last = std::min(last, _instructions.size());
+      Source source{runs[r].offset, {}};
+      for (auto i = runs[r].instruction; i < last; i++) {
+        source.entry.count += _instructions[i].entry.count;
+        source.entry.ticks += _instructions[i].entry.ticks;
+      }
+      v.emplace_back(source);
+    }
+    return v;
+  }
+
+  static uint64_t Now() {
+#ifdef MINIPLC0_HAS_RDTSC
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+  }
+
+ private:
+  static constexpr std::size_t kNone = SIZE_MAX;
+
+  // 一条指令的操作和统计
+  struct Slot {
+    Operation op = ILL;
+    Entry entry;
+  };
+
+  // 把从 _time 到 now 的时间记到上一条指令
+  void record(uint64_t now) {
+    auto &it = _instructions[_last];
+    auto ticks = now - _time;
+    it.entry.count++;
+    it.entry.ticks += ticks;
+    _operations[it.op].count++;
+    _operations[it.op].ticks += ticks;
+  }
+
+ private:
+  std::array<Entry, kOperationCount> _operations;
+  std::vector<Slot> _instructions;
+  std::array<std::array<uint64_t, kOperationCount>, kOperationCount> _pairs;
+  // 正在执行的指令的下标和它开始的时间
+  std::size_t _last;
+  uint64_t _time;
+};
+}  // namespace miniplc0
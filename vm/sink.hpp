@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace miniplc0 {
+
+// 把 value 的十进制写到 out，返回写完之后的位置，最多写 11 个字符
+// 每次处理两位数字，查表得到两个字符
+inline char *FormatInt32(std::int32_t value, char *out) {
+  static constexpr char kDigits[] =
+      "0001020304050607080910111213141516171819"
+      "2021222324252627282930313233343536373839"
+      "4041424344454647484950515253545556575859"
+      "6061626364656667686970717273747576777879"
+      "8081828384858687888990919293949596979899";
+  auto u = static_cast<std::uint32_t>(value);
+  if (value < 0) {
+    *out++ = '-';
+    u = 0u - u;
+  }
+  char buffer[10];
+  char *end = buffer + sizeof(buffer);
+  char *p = end;
+  while (u >= 100) {
+    p -= 2;
+    std::memcpy(p, kDigits + u % 100 * 2, 2);
+    u /= 100;
+  }
+  if (u >= 10) {
+    p -= 2;
+    std::memcpy(p, kDigits + u * 2, 2);
+  } else {
+    *--p = static_cast<char>('0' + u);
+  }
+  std::memcpy(out, p, end - p);
+  return out + (end - p);
+}
+
+// VM::Run() 每执行一条 WRT 就把输出的值交给 sink，而不是在最后一起返回
+class OutputSink {
+ public:
+  virtual ~OutputSink() = default;
+
+  virtual void Write(std::int32_t value) = 0;
+  // 把缓冲的内容全部写出，失败时返回 false，VM::Run() 正常结束时会调用它
+  virtual bool Flush() { return true; }
+};
+
+// 把所有的值收集起来，用于测试
+class CollectingSink final : public OutputSink {
+ public:
+  void Write(std::int32_t value) override { _values.emplace_back(value); }
+
+  const std::vector<std::int32_t> &GetValues() const { return _values; }
+  std::vector<std::int32_t> ReleaseValues() { return std::move(_values); }
+
+ private:
+  std::vector<std::int32_t> _values;
+};
+
+// 写到文件描述符的 sink，内容先放进固定大小的缓冲区，满了之后一次 write(2)
+// 和 OutputWriter 一样，它不拥有文件描述符，也不会关闭它
+class FdSink : public OutputSink {
+ public:
+  static constexpr std::size_t kDefaultCapacity = 1 << 16;
+
+ public:
+  FdSink(const FdSink &) = delete;
+  FdSink &operator=(const FdSink &) = delete;
+  ~FdSink() override { Flush(); }
+
+  bool Flush() override {
+    const char *p = _buffer.data();
+    std::size_t left = _size;
+    while (_good && left > 0) {
+      auto n = writeSome(p, left);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        _good = false;
+        break;
+      }
+      p += n;
+      left -= static_cast<std::size_t>(n);
+      _written += static_cast<std::size_t>(n);
+    }
+    _size = 0;
+    return _good;
+  }
+
+  // 是否发生过写错误
+  bool Good() const { return _good; }
+  // 已经写出的字节数，不包括缓冲区中的
+  std::uint64_t GetBytesWritten() const { return _written; }
+
+ protected:
+  // capacity 至少要能放下一个值
+  FdSink(int fd, std::size_t capacity)
+      : _fd(fd),
+        _buffer(capacity < 16 ? 16 : capacity),
+        _size(0),
+        _good(true),
+        _written(0) {}
+
+  // 返回至少 n 个字节的空闲空间，写完之后用 commit() 提交
+  char *reserve(std::size_t n) {
+    if (_buffer.size() - _size < n) Flush();
+    return _buffer.data() + _size;
+  }
+  void commit(char *end) {
+    _size = static_cast<std::size_t>(end - _buffer.data());
+  }
+
+ private:
+  long writeSome(const char *p, std::size_t n) {
+#ifdef _MSC_VER
+    return _write(_fd, p, static_cast<unsigned int>(n));
+#else
+    return ::write(_fd, p, n);
+#endif
+  }
+
+ private:
+  int _fd;
+  std::vector<char> _buffer;
+  std::size_t _size;
+  bool _good;
+  std::uint64_t _written;
+};
+
+// 每个值一行十进制
+class DecimalSink final : public FdSink {
+ public:
+  explicit DecimalSink(int fd, std::size_t capacity = kDefaultCapacity)
+      : FdSink(fd, capacity) {}
+
+  void Write(std::int32_t value) override {
+    auto p = FormatInt32(value, reserve(12));
+    *p++ = '\n';
+    commit(p);
+  }
+};
+
+// 每个值 4 个字节，小端序，没有分隔
+class BinarySink final : public FdSink {
+ public:
+  explicit BinarySink(int fd, std::size_t capacity = kDefaultCapacity)
+      : FdSink(fd, capacity) {}
+
+  void Write(std::int32_t value) override {
+    auto u = static_cast<std::uint32_t>(value);
+    auto p = reserve(4);
+    for (int i = 0; i < 4; i++) *p++ = static_cast<char>(u >> (8 * i));
+    commit(p);
+  }
+};
+}  // namespace miniplc0
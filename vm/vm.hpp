@@ -0,0 +1,189 @@
+#pragma once
+
+#include <array>
+#include <climits>
+#include <cstdint>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "instruction/instruction.h"
+#include "vm/frame.h"
+#include "vm/profile.hpp"
+#include "vm/sink.hpp"
+
+namespace miniplc0 {
+// This is a simplified version of miniplc0 vm implementation.
+class VM {
+ private:
+  using uint64_t = std::uint64_t;
+  using int32_t = std::int32_t;
+  using int64_t = std::int64_t;
+
+ public:
+  // The stack is sized exactly by AnalyseFrame(). Programs that would pop
+  // from an empty stack or use a negative index are rejected here.
+  VM(std::vector<Instruction> v)
+      : _codes(std::move(v)), _stack(), _ip(0), _sp(0), _verified(false) {
+#ifdef MINIPLC0_PROFILE_VM
+    _profile = nullptr;
+#endif
+    auto frame = AnalyseFrame(_codes);
+    if (!frame.first.has_value())
+      throw std::invalid_argument("invalid stack access at instruction " +
+                                  std::to_string(frame.second.value()));
+    _stack.assign(frame.first.value().Slots(), 0);
+    _verified = !Verify(_codes).has_value();
+  }
+  VM(const VM &) = delete;
+  VM(VM &&) = delete;
+  VM &operator=(VM) = delete;
+
+  // Record every instruction executed by Run() into profile, which must
+  // outlive the VM. Does nothing unless built with MINIPLC0_PROFILE_VM.
+  void SetProfile([[maybe_unused]] VMProfile *profile) {
+#ifdef MINIPLC0_PROFILE_VM
+    _profile = profile;
+#endif
+  }
+
+  std::size_t GetStackSize() const { return _stack.size(); }
+
+  // Verified programs run without any per-instruction check, see Verify().
+  bool IsVerified() const { return _verified; }
+
+  // If it crashes, let it crash.
+  // Only ILL and arithmetic errors trap on verified programs. Others run on
+  // the checked engine, which also traps on invalid stack accesses.
+  // Every WRT goes to sink as soon as it executes, and sink is flushed when
+  // the program finishes. Output before a trap stays in the sink.
+  void Run(OutputSink &sink) {
+    if (_verified)
+      run<false>(sink);
+    else
+      run<true>(sink);
+    sink.Flush();
+  }
+  // Collects all output, for tests.
+  std::vector<int32_t> Run() {
+    CollectingSink sink;
+    Run(sink);
+    return sink.ReleaseValues();
+  }
+
+ private:
+  template <bool kChecked>
+  void run(OutputSink &sink) {
+    auto stack = _stack.data();
+    auto size = _stack.size();
+    // Every run starts from an empty stack, as Verify() assumes.
+    uint64_t sp = 0;
+#ifdef MINIPLC0_PROFILE_VM
+    if (_profile) _profile->Begin(_codes.size());
+#endif
+    for (auto &it : _codes) {
+#ifdef MINIPLC0_PROFILE_VM
+      if (_profile) _profile->Step(&it - _codes.data(), it.GetOperation());
+#endif
+      auto x = it.GetX();
+      switch (it.GetOperation()) {
+        case Operation::ILL:
+          throw std::out_of_range("ILL");
+          break;
+        case Operation::LIT:
+          if constexpr (kChecked) check(sp < size);
+          stack[sp] = x;
+          sp++;
+          break;
+        case Operation::LOD:
+          if constexpr (kChecked)
+            check(sp < size && x >= 0 && uint64_t(x) < size);
+          stack[sp] = stack[x];
+          sp++;
+          break;
+        case Operation::STO:
+          if constexpr (kChecked)
+            check(sp >= 1 && x >= 0 && uint64_t(x) < size);
+          stack[x] = stack[sp - 1];
+          sp--;
+          break;
+        case Operation::ADD:
+          if constexpr (kChecked) check(sp >= 2);
+          stack[sp - 2] = add(stack[sp - 2], stack[sp - 1]);
+          sp--;
+          break;
+        case Operation::SUB:
+          if constexpr (kChecked) check(sp >= 2);
+          stack[sp - 2] = sub(stack[sp - 2], stack[sp - 1]);
+          sp--;
+          break;
+        case Operation::DIV:
+          if constexpr (kChecked) check(sp >= 2);
+          stack[sp - 2] = div(stack[sp - 2], stack[sp - 1]);
+          sp--;
+          break;
+        case Operation::MUL:
+          if constexpr (kChecked) check(sp >= 2);
+          stack[sp - 2] = mul(stack[sp - 2], stack[sp - 1]);
+          sp--;
+          break;
+        case Operation::WRT:
+          if constexpr (kChecked) check(sp >= 1);
+          sink.Write(stack[sp - 1]);
+          sp--;
+          break;
+      }
+    }
+#ifdef MINIPLC0_PROFILE_VM
+    if (_profile) _profile->End();
+#endif
+    _sp = sp;
+  }
+
+  static void check(bool ok) {
+    if (!ok) throw std::out_of_range("invalid stack access");
+  }
+
+  int32_t add(int32_t lhs, int32_t rhs) {
+    int64_t r = (int64_t)lhs + (int64_t)rhs;
+    if (r < INT_MIN || r > INT_MAX)
+      throw std::out_of_range("addition out of range");
+    return lhs + rhs;
+  }
+
+  int32_t sub(int32_t lhs, int32_t rhs) {
+    int64_t r = (int64_t)lhs - (int64_t)rhs;
+    if (r < INT_MIN || r > INT_MAX)
+      throw std::out_of_range("subtraction out of range");
+    return lhs - rhs;
+  }
+
+  // See CSAPP Chapter.2
+  int32_t mul(int32_t lhs, int32_t rhs) {
+    int32_t r = lhs * rhs;
+    if (!lhs || r / lhs == rhs)
+      return r;
+    else
+      throw std::out_of_range("multiplication out of range");
+  }
+
+  int32_t div(int32_t lhs, int32_t rhs) {
+    if (rhs == 0) throw std::out_of_range("divide by zero");
+    if (rhs == -1 && lhs == INT_MIN)
+      throw std::out_of_range("INT_MIN/-1");
+    else
+      return lhs / rhs;
+  }
+
+ private:
+  std::vector<Instruction> _codes;
+  std::vector<int32_t> _stack;
+  uint64_t _ip;
+  uint64_t _sp;
+  bool _verified;
+#ifdef MINIPLC0_PROFILE_VM
+  VMProfile *_profile;
+#endif
+};
+}  // namespace miniplc0